@@ -0,0 +1,104 @@
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "bench_registrar.h"
+
+/** @file: bench_main.cpp
+
+    @brief Runs the registered benchmarks and prints the results as JSON.
+
+    Usage: libicc++bench [--time=seconds] [case...], with no case every one is run.
+*/
+
+namespace bench
+{
+    std::atomic<size_t> allocations(0);
+}
+
+void *operator new(size_t size)
+{
+    bench::allocations++;
+    void *result = std::malloc(size == 0 ? 1 : size);
+    if (result == nullptr)
+        throw std::bad_alloc();
+    return result;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void *p) noexcept
+{
+    operator delete(p);
+}
+
+namespace
+{
+    void print_json(std::ostream &ost, const std::vector<bench::result_t> &results)
+    {
+        ost << "{\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const bench::result_t &r = results[i];
+            double pixels = static_cast<double>(r.pixels) * r.iterations;
+            ost << (i == 0 ? "\n" : ",\n")
+                << "    { \"name\": \"" << r.name << "\""
+                << ", \"pixels\": " << r.pixels
+                << ", \"iterations\": " << r.iterations
+                << ", \"ns_per_pixel\": " << r.seconds * 1e9 / pixels
+                << ", \"mpixels_per_second\": " << pixels / r.seconds * 1e-6
+                << ", \"allocations_per_call\": " << static_cast<double>(r.allocations) / r.iterations
+                << " }";
+        }
+        ost << "\n  ]\n}" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    double min_time = 0.2;
+    std::vector<std::string> selected;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strncmp(argv[i], "--time=", 7) == 0)
+            min_time = std::atof(argv[i] + 7);
+        else
+            selected.push_back(argv[i]);
+    }
+
+    bench::runner_t runner(min_time);
+    try
+    {
+        for (bench_registrar_t::entry_t entry : bench_registrar_t::entries())
+            if (selected.empty() || std::find(selected.begin(), selected.end(), entry.first) != selected.end())
+            {
+                std::cerr << "Running " << entry.first << std::endl;
+                entry.second(runner);
+            }
+    }
+    catch (std::exception &exc)
+    {
+        std::cerr << "Exception:" << exc.what() << std::endl ;
+        return 1;
+    }
+    print_json(std::cout, runner.results());
+    return 0;
+}
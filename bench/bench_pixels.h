@@ -0,0 +1,95 @@
+#ifndef bench_pixels_H
+#define bench_pixels_H
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include "iccpp_color_spaces.h"
+#include "iccpp_rgb.h"
+#include "iccpp_pixel.h"
+
+/** @file: bench_pixels.h
+
+    @brief Reproducible random input pixels for the benchmarks
+*/
+
+namespace bench
+{
+    const size_t pixels = 4096; ///< pixels per call, unless a case needs fewer
+
+    inline double random_unit(void)
+    {
+        return std::rand() / static_cast<double>(RAND_MAX);
+    }
+
+    // full range of integer channels, [0, 1] otherwise
+    template <class S>
+    S random_channel(void)
+    {
+        const double one = std::numeric_limits<S>::is_integer ? std::numeric_limits<S>::max() : 1.0;
+        return static_cast<S>(random_unit() * one);
+    }
+
+    inline void randomize(double &x)
+    {
+        x = random_unit();
+    }
+
+    template <class S, int N>
+    void randomize(iccpp::vector_t<S, N> &x)
+    {
+        for (int i = 0; i < N; i++)
+            x[i] = random_channel<S>();
+    }
+
+    template <class S>
+    void randomize(iccpp::rgb_t<S> &x)
+    {
+        x.red = random_channel<S>();
+        x.green = random_channel<S>();
+        x.blue = random_channel<S>();
+    }
+
+    template <class S>
+    void randomize(iccpp::bgr_t<S> &x)
+    {
+        x.red = random_channel<S>();
+        x.green = random_channel<S>();
+        x.blue = random_channel<S>();
+    }
+
+    inline void randomize(iccpp::xyz_t &x)
+    {
+        x.x = random_unit() * 0.9642;
+        x.y = random_unit();
+        x.z = random_unit() * 0.8249;
+    }
+
+    inline void randomize(iccpp::lab_t &x)
+    {
+        x.L = random_unit() * 100.0;
+        x.a = random_unit() * 200.0 - 100.0;
+        x.b = random_unit() * 200.0 - 100.0;
+    }
+
+    template <class X>
+    std::vector<X> random_pixels(size_t count = pixels)
+    {
+        std::srand(1);
+        std::vector<X> result(count, X());
+        for (X &x : result)
+            randomize(x);
+        return result;
+    }
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef bench_registrar_H
+#define bench_registrar_H
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/** @file: bench_registrar.h
+
+    @brief Registration and timing of benchmark cases
+*/
+
+namespace bench
+{
+    extern std::atomic<size_t> allocations; ///< calls to operator new, counted by bench_main.cpp
+
+    struct result_t
+    {
+        std::string name;
+        size_t      pixels;      ///< pixels processed by one call
+        size_t      iterations;  ///< calls timed
+        double      seconds;     ///< time of all the calls
+        size_t      allocations; ///< operator new calls of all the calls
+    };
+
+    ///
+    /// @brief Times a callable: the number of calls doubles until they last at least
+    ///        the minimum time, then the last batch is recorded
+    ///
+    class runner_t
+    {
+    public:
+        explicit runner_t(double min_time) : min_time_(min_time) {}
+        template <class F>
+        void measure(const std::string &name, size_t pixels, F f)
+        {
+            typedef std::chrono::steady_clock clock_t;
+            f(); // warm up caches and lazily built tables
+            result_t result = { name, pixels, 1, 0.0, 0 };
+            for (;;)
+            {
+                size_t before = allocations.load();
+                clock_t::time_point start = clock_t::now();
+                for (size_t i = 0; i < result.iterations; i++)
+                    f();
+                result.seconds = std::chrono::duration<double>(clock_t::now() - start).count();
+                result.allocations = allocations.load() - before;
+                if (result.seconds >= min_time_)
+                    break;
+                result.iterations *= 2;
+            }
+            results_.push_back(result);
+        }
+        const std::vector<result_t> &results(void) const { return results_; }
+    private:
+        double                  min_time_;
+        std::vector<result_t>   results_;
+    };
+
+    template <class F>
+    class registrar_t
+    {
+    public:
+        using entry_t = std::pair < std::string, F>;
+        typedef std::vector<entry_t> entries_vect_t;
+        registrar_t(F f, const std::string &key)
+        {
+            entries().push_back(entry_t(key, f));
+        }
+        static entries_vect_t &entries(void)
+        {
+            static entries_vect_t the_entries;
+            return the_entries;
+        }
+    };
+
+} // namespace bench
+
+typedef bench::registrar_t<void(*)(bench::runner_t &)> bench_registrar_t;
+
+#define BENCH_CASE(x)  void x(bench::runner_t &) ; bench_registrar_t reg##x(x, #x) ; void x(bench::runner_t &runner)
+
+#endif
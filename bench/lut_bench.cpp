@@ -0,0 +1,166 @@
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <algorithm>
+#include <string>
+#include "iccpp_clut.h"
+#include "iccpp_lut_funct.h"
+#include "iccpp_pixel_traits.h"
+#include "bench_registrar.h"
+#include "bench_pixels.h"
+
+/** @file: lut_bench.cpp
+
+    @brief Throughput of lut_t for 1 to 15 inputs, tetrahedral and multilinear,
+           and of fixed_grid_lut_t and nonuniform_lut_t for 3 and 4 inputs.
+           The lut_t cases with 4 outputs are named after the vector instruction set
+           compiled in the kernels (see clut_kernel_isa).
+*/
+using namespace iccpp;
+
+namespace
+{
+    // grid small enough to keep the table of 15 inputs in memory
+    size_t bench_grid(int inputs)
+    {
+        return inputs <= 3 ? 17 : (inputs <= 5 ? 9 : (inputs <= 8 ? 5 : (inputs <= 11 ? 3 : 2)));
+    }
+
+    template <int N, class I>
+    void bench_lut(bench::runner_t &runner, const char *interpolation, size_t count)
+    {
+        typedef vector_t<double, N> input_t;
+        typedef vector_t<double, 3> output_t;
+        size_t grid = bench_grid(N);
+        size_t steps[N];
+        arithmetic_t<size_t, N>::assign(steps, grid);
+        lut_t<output_t, input_t, I> lut(steps, input_t(1.0 / (grid - 1)));
+        std::vector<output_t> table = bench::random_pixels<output_t>(lut.datasize());
+        for (size_t i = 0; i < table.size(); i++)
+            lut[static_cast<int>(i)] = table[i];
+        std::vector<input_t> x = bench::random_pixels<input_t>(count);
+        std::vector<output_t> y(x.size());
+        runner.measure("lut_t/" + std::to_string(N) + "/" + interpolation, x.size(),
+                       [&] { lut.eval_n(x.data(), y.data(), x.size()); });
+    }
+
+    template <int N, size_t G>
+    void bench_fixed_grid(bench::runner_t &runner, size_t count)
+    {
+        typedef vector_t<double, N> input_t;
+        typedef vector_t<double, 3> output_t;
+        fixed_grid_lut_t<output_t, input_t, G> lut;
+        std::vector<output_t> table = bench::random_pixels<output_t>(lut.datasize());
+        for (size_t i = 0; i < table.size(); i++)
+            lut[static_cast<int>(i)] = table[i];
+        std::vector<input_t> x = bench::random_pixels<input_t>(count);
+        std::vector<output_t> y(x.size());
+        runner.measure("fixed_grid_lut_t/" + std::to_string(N) + "/" + std::to_string(G), x.size(),
+                       [&] { lut.eval_n(x.data(), y.data(), x.size()); });
+    }
+
+    // 4 outputs go through the vector combine of the kernels
+    template <int N>
+    void bench_vector_combine(bench::runner_t &runner, size_t count)
+    {
+        typedef vector_t<double, N> input_t;
+        typedef vector_t<double, 4> output_t;
+        size_t grid = bench_grid(N);
+        size_t steps[N];
+        arithmetic_t<size_t, N>::assign(steps, grid);
+        lut_t<output_t, input_t, interp_tetra_t> lut(steps, input_t(1.0 / (grid - 1)));
+        std::vector<output_t> table = bench::random_pixels<output_t>(lut.datasize());
+        for (size_t i = 0; i < table.size(); i++)
+            lut[static_cast<int>(i)] = table[i];
+        std::vector<input_t> x = bench::random_pixels<input_t>(count);
+        std::vector<output_t> y(x.size());
+        runner.measure("lut_t/" + std::to_string(N) + "/tetra/4/" + clut_kernel_isa, x.size(),
+                       [&] { lut.eval_n(x.data(), y.data(), x.size()); });
+    }
+
+    // breakpoints denser near 0, as for gamma encoded inputs
+    template <int N, size_t G>
+    void bench_nonuniform(bench::runner_t &runner, size_t count)
+    {
+        typedef vector_t<double, N> input_t;
+        typedef vector_t<double, 3> output_t;
+        std::vector<grid_axis_t> axes(N, density_grid_axis([](double t) { return 1.0 / (0.05 + t); }, G));
+        nonuniform_lut_t<output_t, input_t> lut(axes);
+        std::vector<output_t> table = bench::random_pixels<output_t>(lut.datasize());
+        for (size_t i = 0; i < table.size(); i++)
+            lut[static_cast<int>(i)] = table[i];
+        std::vector<input_t> x = bench::random_pixels<input_t>(count);
+        std::vector<output_t> y(x.size());
+        runner.measure("nonuniform_lut_t/" + std::to_string(N) + "/" + std::to_string(G), x.size(),
+                       [&] { lut.eval_n(x.data(), y.data(), x.size()); });
+    }
+
+    // ordering of the simplex for N > 5: sorting network against std::sort
+    template <int N>
+    void bench_sort(bench::runner_t &runner, size_t count)
+    {
+        std::vector<vector_t<double, N>> x = bench::random_pixels<vector_t<double, N>>(count);
+        std::vector<delta_item_t<double>> deltas(x.size() * N);
+        auto load = [&]
+        {
+            for (size_t i = 0; i < x.size(); i++)
+                for (size_t k = 0; k < N; k++)
+                {
+                    deltas[i * N + k].value = x[i][k];
+                    deltas[i * N + k].offset = k;
+                }
+        };
+        runner.measure("permutation_t/" + std::to_string(N) + "/network", x.size(), [&]
+        {
+            load();
+            for (size_t i = 0; i < x.size(); i++)
+                permutation_t<N, true>::indexes(&deltas[i * N]);
+        });
+        runner.measure("permutation_t/" + std::to_string(N) + "/sort", x.size(), [&]
+        {
+            load();
+            for (size_t i = 0; i < x.size(); i++)
+                std::sort(&deltas[i * N], &deltas[i * N] + N,
+                          [](const delta_item_t<double> &lhs, const delta_item_t<double> &rhs)
+                          { return lhs.value > rhs.value; });
+        });
+    }
+
+    template <int N>
+    struct lut_bench_t
+    {
+        static void run(bench::runner_t &runner)
+        {
+            lut_bench_t<N - 1>::run(runner);
+            bench_lut<N, interp_tetra_t>(runner, "tetra", bench::pixels);
+            // multilinear visits 2^N vertices per pixel
+            bench_lut<N, interp_multi_t>(runner, "multi", N > 10 ? bench::pixels / 16 : bench::pixels);
+            if (N > 5)
+                bench_sort<N>(runner, bench::pixels);
+        }
+    };
+
+    template <>
+    struct lut_bench_t<0>
+    {
+        static void run(bench::runner_t &) {}
+    };
+}
+
+BENCH_CASE(lut_bench)
+{
+    lut_bench_t<15>::run(runner);
+    // compare with lut_t/3/tetra and lut_t/4/tetra
+    bench_fixed_grid<3, 17>(runner, bench::pixels);
+    bench_fixed_grid<4, 9>(runner, bench::pixels);
+    bench_nonuniform<3, 17>(runner, bench::pixels);
+    bench_nonuniform<4, 9>(runner, bench::pixels);
+    bench_vector_combine<3>(runner, bench::pixels);
+    bench_vector_combine<4>(runner, bench::pixels);
+}
@@ -0,0 +1,89 @@
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <cmath>
+#include <string>
+#include "iccpp_curve.h"
+#include "iccpp_color_spaces.h"
+#include "bench_registrar.h"
+#include "bench_pixels.h"
+
+/** @file: stage_bench.cpp
+
+    @brief Throughput of the single stages: curves, matrices and color conversions
+*/
+using namespace iccpp;
+
+namespace
+{
+    template <class Y, class X>
+    void bench_algo(bench::runner_t &runner, const std::string &name, algo_t<Y, X> *algo)
+    {
+        function_t<Y, X> f(algo);
+        std::vector<X> x = bench::random_pixels<X>();
+        std::vector<Y> y(x.size());
+        runner.measure(name, x.size(), [&] { f.eval_n(x.data(), y.data(), x.size()); });
+    }
+
+    std::vector<double> bench_knots(size_t count)
+    {
+        std::vector<double> knots;
+        for (size_t i = 0; i < count; i++)
+            knots.push_back(std::pow(i / (count - 1.0), 2.2));
+        return knots;
+    }
+}
+
+BENCH_CASE(curve_bench)
+{
+    bench_algo(runner, "icc_gamma_curve_t", new icc_gamma_curve_t(2.2));
+    bench_algo(runner, "icc_curve_parametric_t", new icc_curve_parametric_t(2.4, 1 / 1.055, 0.055 / 1.055, 1 / 12.92, 0.04045, 0.0, 0.0));
+    bench_algo(runner, "icc_curve_interpolated_t/256", new icc_curve_interpolated_t(bench_knots(256)));
+    bench_algo(runner, "icc_curve_interpolated_t/4096", new icc_curve_interpolated_t(bench_knots(4096)));
+    bench_algo(runner, "icc_curve_baked_t/4096", icc_curve_baked_t::sample(icc_gamma_curve_t(2.2), baked_curve_knots));
+    algo_t<double, double> *components[3] = { new icc_gamma_curve_t(2.2),
+                                              new icc_curve_parametric_t(2.4, 1 / 1.055, 0.055 / 1.055, 1 / 12.92, 0.04045, 0.0, 0.0),
+                                              new icc_curve_interpolated_t(bench_knots(256)) };
+    std::unique_ptr<icc_curve_t<3>> curve(new icc_curve_t<3>(components));
+    bench_algo(runner, "icc_curve_t/3/baked", dynamic_cast<icc_curve_t<3> *>(curve->bake()));
+    bench_algo(runner, "icc_curve_t/3", curve.release());
+}
+
+BENCH_CASE(matrix_bench)
+{
+    icc_matrix_linear_t<3, 3> *linear = new icc_matrix_linear_t<3, 3>;
+    icc_matrix_affine_t<3, 3> *affine = new icc_matrix_affine_t<3, 3>;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            (*linear)[i][j] = (*affine)[i][j] = (i == j ? 0.8 : 0.1);
+    for (int i = 0; i < 3; i++)
+        (*affine)[i][3] = 0.05;
+    bench_algo(runner, "icc_matrix_linear_t/3x3", linear);
+    bench_algo(runner, "icc_matrix_affine_t/3x3", affine);
+}
+
+BENCH_CASE(conversion_bench)
+{
+    typedef vector_t<double, 3> vector3_t;
+    bench_algo(runner, "color_conversion_t/lab<-xyz", new color_conversion_t<lab_t, xyz_t>);
+    bench_algo(runner, "color_conversion_t/xyz<-lab", new color_conversion_t<xyz_t, lab_t>);
+    bench_algo(runner, "color_conversion_t/rgb<-xyz", new color_conversion_t<rgb_t<double>, xyz_t>);
+    bench_algo(runner, "color_conversion_t/xyz<-rgb", new color_conversion_t<xyz_t, rgb_t<double>>);
+    bench_algo(runner, "color_conversion_t/rgb<-vector3", new color_conversion_t<rgb_t<double>, vector3_t>);
+    bench_algo(runner, "color_conversion_t/vector3<-rgb", new color_conversion_t<vector3_t, rgb_t<double>>);
+    bench_algo(runner, "color_conversion_t/rgb8<-rgb", new color_conversion_t<rgb_t<unsigned char>, rgb_t<double>>);
+    bench_algo(runner, "color_conversion_t/bgr8<-bgr", new color_conversion_t<bgr_t<unsigned char>, bgr_t<double>>);
+    bench_algo(runner, "color_conversion_t/rgb8<-bgr", new color_conversion_t<rgb_t<unsigned char>, bgr_t<double>>);
+    bench_algo(runner, "color_conversion_t/bgr<-rgb8", new color_conversion_t<bgr_t<double>, rgb_t<unsigned char>>);
+    bench_algo(runner, "color_conversion_t/xyz<-vector3", new color_conversion_t<xyz_t, vector3_t>);
+    bench_algo(runner, "color_conversion_t/vector3<-xyz", new color_conversion_t<vector3_t, xyz_t>);
+    bench_algo(runner, "color_conversion_t/lab<-vector3", new color_conversion_t<lab_t, vector3_t>);
+    bench_algo(runner, "color_conversion_t/vector3<-lab", new color_conversion_t<vector3_t, lab_t>);
+    bench_algo(runner, "color_conversion_t/vector4_8<-vector4", new color_conversion_t<vector_t<unsigned char, 4>, vector_t<double, 4>>);
+}
@@ -0,0 +1,124 @@
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <string>
+#include "iccpp_converters.h"
+#include "iccpp_planar_image.h"
+#include "iccpp_curve.h"
+#include "iccpp_optimizer.h"
+#include "bench_registrar.h"
+#include "bench_pixels.h"
+
+/** @file: transform_bench.cpp
+
+    @brief Throughput of whole transforms built by transform_t::create, and of a
+           matrix/shaper chain before and after optimize()
+*/
+using namespace iccpp;
+
+namespace
+{
+    template <class P>
+    void bench_transform(bench::runner_t &runner, const std::string &name)
+    {
+        // sRGB -> Lab on the input side, XYZ -> sRGB on the output side
+        function_t<rgb_t<double>, xyz_t> output(new xyz2rgb_t);
+        function_t<lab_t, rgb_t<double>> input = function_t<lab_t, xyz_t>(new xyz2lab_t) * function_t<xyz_t, rgb_t<double>>(new rgb2xyz_t);
+        std::vector<P> x = bench::random_pixels<P>();
+        std::vector<P> y(x.size());
+
+        struct variant_t
+        {
+            const char          *name;
+            transform_options_t  options;
+        };
+        const variant_t variants[] = { { "plain", transform_options_t() },
+                                       { "optimized", transform_options_t(true) },
+                                       { "precomputed", transform_options_t(true, true) },
+                                       { "fixed_point", transform_options_t(false, false, 1e-3, true) } };
+        for (const variant_t &variant : variants)
+        {
+            if (variant.options.fixed_point && !fixed_pixel_t<P>::value)
+                continue;
+            function_t<P, P> f = transform_t::create<P, P>(output.get(), input.get(), variant.options);
+            if (!f)
+                continue;
+            runner.measure("transform_t/" + name + "/" + variant.name, x.size(),
+                           [&] { f.eval_n(x.data(), y.data(), x.size()); });
+        }
+    }
+}
+
+BENCH_CASE(transform_bench)
+{
+    bench_transform<rgb_t<unsigned char>>(runner, "rgb8");
+    bench_transform<rgb_t<unsigned short>>(runner, "rgb16");
+    bench_transform<rgb_t<double>>(runner, "rgb");
+}
+
+// the same fixed point transform on an interleaved and on a planar image
+BENCH_CASE(planar_bench)
+{
+    using pixel_t = rgb_t<unsigned char>;
+    function_t<rgb_t<double>, xyz_t> output(new xyz2rgb_t);
+    function_t<lab_t, rgb_t<double>> input = function_t<lab_t, xyz_t>(new xyz2lab_t) * function_t<xyz_t, rgb_t<double>>(new rgb2xyz_t);
+    function_t<pixel_t, pixel_t> f = transform_t::create<pixel_t, pixel_t>(output.get(), input.get(),
+                                                                          transform_options_t(false, false, 1e-3, true));
+    std::vector<pixel_t> x = bench::random_pixels<pixel_t>();
+    point_t size = { 256, static_cast<int>(x.size() / 256) };
+    image_t<pixel_t> src(x.data(), size);
+    image_t<pixel_t> dest(size);
+    planar_image_t<pixel_t> planar(size);
+    planar.apply(function_t<pixel_t, pixel_t>(new identity_t<pixel_t>), src);
+    planar_image_t<pixel_t> planar_dest(size);
+    runner.measure("image_t/rgb8/fixed_point", x.size(), [&] { dest.apply(f, src); });
+    runner.measure("planar_image_t/rgb8/fixed_point", x.size(), [&] { planar_dest.apply(f, planar); });
+}
+
+// sampling a transform into a 33 point lookup table, per node, on one thread and on the pool
+BENCH_CASE(make_lut_bench)
+{
+    using pixel_t = rgb_t<double>;
+    function_t<rgb_t<double>, xyz_t> output(new xyz2rgb_t);
+    function_t<lab_t, rgb_t<double>> input = function_t<lab_t, xyz_t>(new xyz2lab_t) * function_t<xyz_t, rgb_t<double>>(new rgb2xyz_t);
+    function_t<pixel_t, pixel_t> f = transform_t::create<pixel_t, pixel_t>(output.get(), input.get(), transform_options_t(true));
+    const size_t grid = 33;
+    size_t steps[] = { grid, grid, grid };
+    pixel_t step = lut_input_traits_t<pixel_t>::uniform(1.0 / (grid - 1));
+    worker_pool_t serial(1);
+    runner.measure("make_lut/rgb/33/serial", grid * grid * grid,
+                   [&] { make_lut<pixel_t, pixel_t, interp_tetra_t>(f, steps, step, serial); });
+    runner.measure("make_lut/rgb/33/pool", grid * grid * grid,
+                   [&] { make_lut<pixel_t, pixel_t, interp_tetra_t>(f, steps, step); });
+}
+
+// RGB to RGB through two matrix/shaper profiles: optimize() multiplies the matrices
+// and bakes the sRGB curves, the gamma 1 / 2.2 curves are too steep near 0 to be baked
+BENCH_CASE(optimizer_bench)
+{
+    using vector3_t = vector_t<double, 3>;
+    const double rgb2xyz[3][3] = { { 0.4124, 0.3576, 0.1805 }, { 0.2126, 0.7152, 0.0722 }, { 0.0193, 0.1192, 0.9505 } };
+    const double xyz2rgb[3][3] = { { 2.0414, -0.5649, -0.3447 }, { -0.9693, 1.8760, 0.0416 }, { 0.0134, -0.1184, 1.0154 } };
+    algo_t<double, double> *srgb[3];
+    algo_t<double, double> *gamma[3];
+    for (int i = 0; i < 3; i++)
+    {
+        srgb[i] = new icc_curve_parametric_t(2.4, 1 / 1.055, 0.055 / 1.055, 1 / 12.92, 0.04045);
+        gamma[i] = new icc_gamma_curve_t(1 / 2.2);
+    }
+    function_t<vector3_t, vector3_t> f = function_t<vector3_t, vector3_t>(new icc_curve_t<3>(gamma)) *
+                                         (function_t<vector3_t, vector3_t>(new icc_matrix_linear_t<3, 3>(xyz2rgb)) *
+                                          (function_t<vector3_t, vector3_t>(new icc_matrix_linear_t<3, 3>(rgb2xyz)) *
+                                           function_t<vector3_t, vector3_t>(new icc_curve_t<3>(srgb))));
+    function_t<vector3_t, vector3_t> g = optimize(f);
+    std::vector<vector3_t> x = bench::random_pixels<vector3_t>();
+    std::vector<vector3_t> y(x.size());
+    runner.measure("optimize/matrix_shaper/plain", x.size(), [&] { f.eval_n(x.data(), y.data(), x.size()); });
+    runner.measure("optimize/matrix_shaper/optimized", x.size(), [&] { g.eval_n(x.data(), y.data(), x.size()); });
+}
@@ -10,9 +10,14 @@
 // http://www.boost.org/LICENSE_1_0.txt)
 //
 
+#include "iccpp_function.h"
 #include "iccpp_pixel.h"
 #include "iccpp_traits.h"
 #include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 #include <string.h>
 
 namespace iccpp
@@ -25,6 +30,88 @@ namespace iccpp
         operator T(void) const { return value; }
     };
 
+    //
+    // Batcher's merge exchange (Knuth, TAOCP 5.2.2, algorithm M) as a sorting network
+    // generated at compile time: every step is a compare-exchange of two fixed
+    // positions, none of them branches on the data. Sorting is in decreasing order.
+    //
+    template <class T>
+    inline void compare_exchange(delta_item_t<T> &lhs, delta_item_t<T> &rhs)
+    {
+        T lvalue = lhs.value, rvalue = rhs.value;
+        // offsets are swapped through a mask, so that the compiler has no branch to emit
+        size_t mask = static_cast<size_t>(0) - static_cast<size_t>(lvalue < rvalue);
+        size_t swap = (lhs.offset ^ rhs.offset) & mask;
+        lhs.value = std::max(lvalue, rvalue);
+        rhs.value = std::min(lvalue, rvalue);
+        lhs.offset ^= swap;
+        rhs.offset ^= swap;
+    }
+
+    // largest power of 2 less than n
+    constexpr size_t merge_exchange_top(size_t n, size_t p = 1)
+    {
+        return 2 * p < n ? merge_exchange_top(n, 2 * p) : p;
+    }
+
+    // step M3: compares i and i + d for all i such that i & p == r
+    template <size_t N, size_t I, size_t P, size_t R, size_t D, bool = (I + D < N)>
+    struct merge_exchange_step_t
+    {
+        template <class T>
+        static void apply(delta_item_t<T> *items)
+        {
+            if ((I & P) == R)
+                compare_exchange(items[I], items[I + D]);
+            merge_exchange_step_t<N, I + 1, P, R, D>::apply(items);
+        }
+    };
+    template <size_t N, size_t I, size_t P, size_t R, size_t D>
+    struct merge_exchange_step_t<N, I, P, R, D, false>
+    {
+        template <class T>
+        static void apply(delta_item_t<T> *) {}
+    };
+
+    // steps M3-M4: one merge for a given p, q halving down to p
+    template <size_t N, size_t P, size_t Q, size_t R, size_t D, bool = (Q == P)>
+    struct merge_exchange_pass_t
+    {
+        template <class T>
+        static void apply(delta_item_t<T> *items)
+        {
+            merge_exchange_step_t<N, 0, P, R, D>::apply(items);
+            merge_exchange_pass_t<N, P, Q / 2, P, Q - P>::apply(items);
+        }
+    };
+    template <size_t N, size_t P, size_t Q, size_t R, size_t D>
+    struct merge_exchange_pass_t<N, P, Q, R, D, true>
+    {
+        template <class T>
+        static void apply(delta_item_t<T> *items)
+        {
+            merge_exchange_step_t<N, 0, P, R, D>::apply(items);
+        }
+    };
+
+    // steps M2-M5: p from the top power of 2 down to 1
+    template <size_t N, size_t P = merge_exchange_top(N)>
+    struct merge_exchange_t
+    {
+        template <class T>
+        static void apply(delta_item_t<T> *items)
+        {
+            merge_exchange_pass_t<N, P, merge_exchange_top(N), 0, P>::apply(items);
+            merge_exchange_t<N, P / 2>::apply(items);
+        }
+    };
+    template <size_t N>
+    struct merge_exchange_t<N, 0>
+    {
+        template <class T>
+        static void apply(delta_item_t<T> *) {}
+    };
+
     template <int N, bool>
     class permutation_t
     {
@@ -32,46 +119,24 @@ namespace iccpp
         template <class T>
         static void indexes(delta_item_t<T> *items) 
         {
-            std::sort(items,
-                      items + N,
-                      [](const delta_item_t<T> &lhs, const delta_item_t<T> &rhs)
-                      { return lhs.value > rhs.value; });
+            merge_exchange_t<N>::apply(items);
         }
     };
 
-    // specialized class for low N 
+    // specialized class for low N: sorting goes through a table of permutations
+    // indexed by the outcome of all comparisons. The table is built on first use
+    // and shared by all the instances
     template <int N>
     class permutation_t<N, false>
     {
     public:
-        permutation_t(void)
-        {
-            // no metaprogramming here, speed is not critical
-            size_t perm[N];
-            for (size_t i = 0; i < N; i++)
-                perm[i] = i;
-            memset(perm_, sizeof(perm_), 0);
-            do
-            {
-                size_t *line = perm_[signature(perm)];
-                delta_item_t<size_t> items[N];
-                for (size_t i = 0; i < N; i++)
-                {
-                    items[i].value = perm[i];
-                    items[i].offset = i;
-                }
-                permutation_t<N, true>::indexes(items);
-                for (size_t i = 0; i < N; i++)
-                    line[i] = items[i].offset;
-            } while (std::next_permutation(perm, perm + N));
-        }
         template <class T>
-        void indexes(delta_item_t<T> *items) const
+        static void indexes(delta_item_t<T> *items)
         {
             delta_item_t<T> temp[N];
 
             std::copy(items, items + N, temp);
-            const size_t *perm = perm_[signature(items)];
+            const size_t *perm = table().perm[signature(items)];
             permute(items, temp, perm);
         }
         // makes all comparisons (data[i], data[j]), i < j and set a bit for every true result
@@ -93,11 +158,40 @@ namespace iccpp
             return (ref > data[0] ? 0 : 1) + (permutation_t<N - 1, false>::linear(ref, data + 1) << 1);
         }
     private:
-        // size of this array is given by the number of comparisons
-        // this scheme assumes the comparison of all pairs
-        // for n = 5 means 10 bits, 1024 entries in the table
-        // for greater values of N precomputing is no longer worth the game...
-        size_t perm_[1 << ((N-1)*N/2)][N];
+        struct table_t
+        {
+            table_t(void) : perm()
+            {
+                // no metaprogramming here, speed is not critical
+                size_t order[N];
+                for (size_t i = 0; i < N; i++)
+                    order[i] = i;
+                do
+                {
+                    size_t *line = perm[signature(order)];
+                    delta_item_t<size_t> items[N];
+                    for (size_t i = 0; i < N; i++)
+                    {
+                        items[i].value = order[i];
+                        items[i].offset = i;
+                    }
+                    permutation_t<N, true>::indexes(items);
+                    for (size_t i = 0; i < N; i++)
+                        line[i] = items[i].offset;
+                } while (std::next_permutation(order, order + N));
+            }
+            // size of this array is given by the number of comparisons
+            // this scheme assumes the comparison of all pairs
+            // for n = 5 means 10 bits, 1024 entries in the table
+            // for greater values of N precomputing is no longer worth the game...
+            // entries of impossible outcomes stay 0
+            size_t perm[1 << ((N-1)*N/2)][N];
+        };
+        static const table_t &table(void)
+        {
+            static const table_t instance; // thread safe initialization
+            return instance;
+        }
     };
     template <>
     struct permutation_t<1, false>
@@ -112,7 +206,7 @@ namespace iccpp
             dest[0] = src[perm[0]];
         }
         template <class T>
-        void indexes(delta_item_t<T> *) const {  }
+        static void indexes(delta_item_t<T> *) {  }
     };
     //
     // this helper is required to keep vector_t out of lut_t
@@ -122,6 +216,7 @@ namespace iccpp
     struct lut_input_traits_t
     {
         typedef X scalar_type;
+        enum { supported = false }; // true when X can be domain and range of a lut_t
     };
 
 
@@ -221,17 +316,9 @@ namespace iccpp
                 size1_[i] = size[i] - 1;
                 offset_[i + 1] = offset_[i] * size_[i];
             }
-            data_ = new Y[offset_[N]];
-        }
-        ~arrayn_t(void)
-        {
-            delete[] data_;
-        }
-        void copy_table(const arrayn_t<Y, N> &rhs)
-        {
-            if (offset_[N] == rhs.offset_[N])
-                memcpy(data_, rhs.data_, offset_[N] * sizeof(Y));
+            data_.reset(new Y[offset_[N]], std::default_delete<Y[]>());
         }
+        // copies share the table, writing through operator[] detaches a private copy
         //
         // Accessors
         //
@@ -239,39 +326,112 @@ namespace iccpp
         const size_t *size(void) const { return size_; }
         const size_t *size1(void) const { return size1_; }
         const size_t *offset(void) const { return offset_; }
-        template <class S> // S is a scalar
-        Y combine(delta_item_t<S> *deltas, interp_tetra_t) const
+        template <class S, class I> // S is a scalar
+        Y combine(delta_item_t<S> *deltas, I interpolation) const
         {
             // computes offset of first cube
             // and substitutes the indexes with offset for each dimension
-            const Y *data = data_ + iteration_t<S, N>::substitute(deltas, offset_);
+            return combine_at(iteration_t<S, N>::substitute(deltas, offset_), deltas, interpolation);
+        }
+        // base is the offset of the first cube, deltas already hold the offset of their dimension
+        template <class S>
+        Y combine_at(size_t base, delta_item_t<S> *deltas, interp_tetra_t) const
+        {
+            const Y *data = data_.get() + base;
             // sort deltas to have them in decreasing order
-            perm_.indexes(deltas);
+            permutation_t<N, (N > 5)>::indexes(deltas);
             // for byte type one() is 256, hence the trait
             return data[0] * (scalar_traits_t<S>::one() - deltas->value) +
                                voxel_sum_t<Y, S, N>::tetrahedral(data, deltas);
         }
         template <class S>
-        Y combine(delta_item_t<S> *deltas, interp_multi_t) const
+        Y combine_at(size_t base, delta_item_t<S> *deltas, interp_multi_t) const
         {
-            // computes offset of first cube
-            // and substitutes the indexes with offset for each dimension
-            const Y *data = data_ + iteration_t<S, N>::substitute(deltas, offset_);
-            return voxel_sum_t<Y, S, N>::multilinear(data, deltas);
+            return voxel_sum_t<Y, S, N>::multilinear(data_.get() + base, deltas);
         }
 
         // that's a bit silly but effective....
-        Y &operator[](int index) { return data_[index]; }
+        Y &operator[](int index)
+        {
+            if (data_.use_count() > 1)
+                detach();
+            return data_.get()[index];
+        }
+        const Y *data(void) const { return data_.get(); }
     private:
+        void detach(void)
+        {
+            std::shared_ptr<Y> copy(new Y[offset_[N]], std::default_delete<Y[]>());
+            std::copy(data_.get(), data_.get() + offset_[N], copy.get());
+            data_ = copy;
+        }
         size_t                    size_[N];
         size_t                    size1_[N]; // == size-1, useful precomputed value
         size_t                    offset_[N + 1];
-        Y                        *data_;
-        permutation_t<N, (N > 5)> perm_;
+        std::shared_ptr<Y>        data_;
+    };
+
+    ///
+    /// @brief Maps input coordinates to grid cells of a lut_t: step and
+    ///        grid size are read at run time
+    ///
+    template <class X>
+    class lut_axes_t
+    {
+    public:
+        lut_axes_t(const X &step, const size_t *size1) : step_(step), size1_(size1) {}
+        /// index of the cell along axis k, fraction gets the position inside the cell
+        template <class T>
+        size_t cell(T x, size_t k, T &fraction) const
+        {
+            T t = x / step_[k];
+            size_t index = static_cast<size_t>(t);
+            index -= index / size1_[k]; // same clamping as iteration_t::split
+            fraction = t - index;
+            return index;
+        }
+    private:
+        const X         &step_;
+        const size_t    *size1_;
+    };
+
+    ///
+    /// @brief Maps input coordinates to grid cells of a fixed_grid_lut_t: with
+    ///        G points on each axis scaling is a multiplication by a constant
+    ///        and the clamping a division by a constant
+    ///
+    template <size_t G>
+    struct fixed_grid_axes_t
+    {
+        static_assert(G > 1, "a grid needs at least two points per axis");
+        template <class T>
+        size_t cell(T x, size_t, T &fraction) const
+        {
+            T t = x * static_cast<T>(G - 1);
+            size_t index = static_cast<size_t>(t);
+            index -= index / (G - 1);
+            fraction = t - index;
+            return index;
+        }
+    };
+
+    ///
+    /// @brief Span kernels for lut_t. The generic one declines (returns false)
+    ///        and lut_t interpolates one value at a time. 
+    ///        Specializations are in iccpp_clut_kernels.h
+    ///
+    template <class Y, class X, class I>
+    struct lut_kernel_t
+    {
+        template <class Axes>
+        static bool eval_n(const arrayn_t<Y, X::dimension> &, const Axes &, const X *, Y *, size_t)
+        {
+            return false;
+        }
     };
 
     template <class Y, class X, class I = interp_tetra_t>
-    class lut_t : public algo_t<Y, X>
+    class lut_t : public algo_span_t<lut_t<Y, X, I>, Y, X>
     {
     public:
         enum {dimension = X::dimension};
@@ -290,16 +450,226 @@ namespace iccpp
             // build the interpolation
             return data_.combine(deltas, I());
         }
+        virtual void eval_n(const X *x, Y *y, size_t n) const override
+        {
+            if (!lut_kernel_t<Y, X, I>::eval_n(data_, lut_axes_t<X>(step_, data_.size1()), x, y, n))
+                algo_span_t<lut_t<Y, X, I>, Y, X>::eval_n(x, y, n);
+        }
+        const arrayn_t<Y, dimension> &table(void) const { return data_; }
         lut_t<Y, X, I> *clone(void) const override
         {
-            lut_t<Y, X, I> *result = new lut_t<Y, X, I>(data_.size(), step_);
-            result->data_.copy_table(data_);
-            return result;
+            return new lut_t<Y, X, I>(*this); // table is shared
         }
      private:
-        arrayn_t<Y, dimension>  data_; // TODO: consider sharing this data...
+        arrayn_t<Y, dimension>  data_;
         X                       step_;
     };
 
+    ///
+    /// @brief lut_t with G grid points on every axis, the domain being [0, 1].
+    ///        Being G a constant the offsets of the axes are powers of G known
+    ///        at compile time and no division is left in the index computation.
+    ///        Tables are filled as for lut_t, the layout is the same.
+    ///
+    template <class Y, class X, size_t G, class I = interp_tetra_t>
+    class fixed_grid_lut_t : public algo_span_t<fixed_grid_lut_t<Y, X, G, I>, Y, X>
+    {
+    public:
+        enum {dimension = X::dimension};
+        enum {grid = G};
+        using input_traits_t = lut_input_traits_t<X>;
+        using scalar_type = typename input_traits_t::scalar_type;
+        using weight_type = typename input_traits_t::weight_type;
+        static_assert(std::is_floating_point<scalar_type>::value, "fixed_grid_lut_t requires a floating point domain");
+        fixed_grid_lut_t(void) : data_(grid_table()) {}
+        size_t datasize(void) const { return data_.datasize(); }
+        Y &operator[](int index) { return data_[index]; }
+        virtual Y eval(const X &x) const override
+        {
+            const scalar_type *src = input_traits_t::scalar(x);
+            delta_item_t<weight_type> deltas[dimension];
+            size_t base = 0;
+            size_t offset = 1;
+            for (size_t k = 0; k < dimension; k++, offset *= G)
+            {
+                scalar_type fraction;
+                base += fixed_grid_axes_t<G>().cell(src[k], k, fraction) * offset;
+                deltas[k].value = fraction;
+                deltas[k].offset = offset;
+            }
+            return data_.combine_at(base, deltas, I());
+        }
+        virtual void eval_n(const X *x, Y *y, size_t n) const override
+        {
+            if (!lut_kernel_t<Y, X, I>::eval_n(data_, fixed_grid_axes_t<G>(), x, y, n))
+                algo_span_t<fixed_grid_lut_t<Y, X, G, I>, Y, X>::eval_n(x, y, n);
+        }
+        const arrayn_t<Y, dimension> &table(void) const { return data_; }
+        fixed_grid_lut_t<Y, X, G, I> *clone(void) const override
+        {
+            return new fixed_grid_lut_t<Y, X, G, I>(*this); // table is shared
+        }
+    private:
+        static arrayn_t<Y, dimension> grid_table(void)
+        {
+            size_t size[dimension];
+            std::fill(size, size + dimension, G);
+            return arrayn_t<Y, dimension>(size);
+        }
+        arrayn_t<Y, dimension>  data_;
+    };
+
+    ///
+    /// @brief Breakpoints of one axis of a nonuniform_lut_t, increasing from 0 to 1.
+    ///        A small uniform index table gives for a coordinate the first cell to try,
+    ///        the right one is at most a few breakpoints after it.
+    ///
+    class grid_axis_t
+    {
+    public:
+        enum { bins_per_cell = 4 }; ///< entries of the index table per cell
+        /// at least 2 strictly increasing breakpoints from 0 to 1,
+        /// std::invalid_argument is thrown otherwise
+        explicit grid_axis_t(const std::vector<double> &breakpoints) :
+            breakpoints_(checked(breakpoints)),
+            inverse_(breakpoints.size() - 1),
+            index_(bins_per_cell * (breakpoints.size() - 1))
+        {
+            for (size_t i = 0; i < inverse_.size(); i++)
+                inverse_[i] = 1.0 / (breakpoints_[i + 1] - breakpoints_[i]);
+            scale_ = static_cast<double>(index_.size());
+            size_t cell = 0;
+            for (size_t b = 0; b < index_.size(); b++)
+            {
+                double start = b / scale_;
+                while (cell + 2 < breakpoints_.size() && breakpoints_[cell + 1] <= start)
+                    cell++;
+                index_[b] = cell;
+            }
+        }
+        size_t size(void) const { return breakpoints_.size(); }
+        double operator[](size_t i) const { return breakpoints_[i]; }
+        /// index of the cell holding x, fraction gets the position inside the cell
+        template <class T>
+        size_t cell(T x, T &fraction) const
+        {
+            double t = x * scale_;
+            size_t bin = t <= 0 ? 0 : std::min(static_cast<size_t>(t), index_.size() - 1);
+            size_t index = index_[bin];
+            while (index + 2 < breakpoints_.size() && x >= breakpoints_[index + 1])
+                index++;
+            fraction = static_cast<T>((x - breakpoints_[index]) * inverse_[index]);
+            return index;
+        }
+    private:
+        static const std::vector<double> &checked(const std::vector<double> &breakpoints)
+        {
+            if (breakpoints.size() < 2)
+                throw std::invalid_argument("grid_axis_t needs at least 2 breakpoints");
+            if (breakpoints.front() != 0.0 || breakpoints.back() != 1.0)
+                throw std::invalid_argument("grid_axis_t breakpoints must go from 0 to 1");
+            for (size_t i = 1; i < breakpoints.size(); i++)
+                if (!(breakpoints[i - 1] < breakpoints[i]))
+                    throw std::invalid_argument("grid_axis_t breakpoints must be strictly increasing");
+            return breakpoints;
+        }
+        std::vector<double> breakpoints_;
+        std::vector<double> inverse_; // 1 / width of each cell
+        std::vector<size_t> index_;   // first cell of each bin
+        double              scale_;   // bins in [0, 1]
+    };
+
+    ///
+    /// @brief Maps input coordinates to cells of a nonuniform_lut_t
+    ///
+    class grid_axes_t
+    {
+    public:
+        explicit grid_axes_t(const grid_axis_t *axes) : axes_(axes) {}
+        template <class T>
+        size_t cell(T x, size_t k, T &fraction) const
+        {
+            return axes_[k].cell(x, fraction);
+        }
+    private:
+        const grid_axis_t *axes_;
+    };
+
+    ///
+    /// @brief lut_t whose nodes lie on a grid_axis_t for each input: where the function
+    ///        bends more (gamma encoded RGB, L*) nodes get closer, so that fewer
+    ///        of them reach the accuracy of a uniform grid.
+    ///        Tables are filled as for lut_t, node() gives the input of each entry.
+    ///
+    template <class Y, class X, class I = interp_tetra_t>
+    class nonuniform_lut_t : public algo_span_t<nonuniform_lut_t<Y, X, I>, Y, X>
+    {
+    public:
+        enum {dimension = X::dimension};
+        using input_traits_t = lut_input_traits_t<X>;
+        using scalar_type = typename input_traits_t::scalar_type;
+        using weight_type = typename input_traits_t::weight_type;
+        static_assert(std::is_floating_point<scalar_type>::value, "nonuniform_lut_t requires a floating point domain");
+        /// one axis for each input, std::invalid_argument is thrown otherwise
+        explicit nonuniform_lut_t(const std::vector<grid_axis_t> &axes) :
+            data_(grid_sizes(axes).data()),
+            axes_(std::make_shared<const std::vector<grid_axis_t>>(axes))
+        {
+        }
+        size_t datasize(void) const { return data_.datasize(); }
+        Y &operator[](int index) { return data_[index]; }
+        const grid_axis_t &axis(size_t k) const { return (*axes_)[k]; }
+        /// input mapped to entry index of the table
+        X node(size_t index) const
+        {
+            X result;
+            for (size_t k = 0; k < dimension; k++)
+            {
+                size_t size = data_.size()[k];
+                result[k] = static_cast<scalar_type>(axis(k)[index % size]);
+                index /= size;
+            }
+            return result;
+        }
+        virtual Y eval(const X &x) const override
+        {
+            const scalar_type *src = input_traits_t::scalar(x);
+            const size_t *offset = data_.offset();
+            delta_item_t<weight_type> deltas[dimension];
+            size_t base = 0;
+            for (size_t k = 0; k < dimension; k++)
+            {
+                scalar_type fraction;
+                base += axis(k).cell(src[k], fraction) * offset[k];
+                deltas[k].value = fraction;
+                deltas[k].offset = offset[k];
+            }
+            return data_.combine_at(base, deltas, I());
+        }
+        virtual void eval_n(const X *x, Y *y, size_t n) const override
+        {
+            if (!lut_kernel_t<Y, X, I>::eval_n(data_, grid_axes_t(axes_->data()), x, y, n))
+                algo_span_t<nonuniform_lut_t<Y, X, I>, Y, X>::eval_n(x, y, n);
+        }
+        const arrayn_t<Y, dimension> &table(void) const { return data_; }
+        nonuniform_lut_t<Y, X, I> *clone(void) const override
+        {
+            return new nonuniform_lut_t<Y, X, I>(*this); // table and axes are shared
+        }
+    private:
+        static std::vector<size_t> grid_sizes(const std::vector<grid_axis_t> &axes)
+        {
+            if (axes.size() != dimension)
+                throw std::invalid_argument("nonuniform_lut_t needs one axis for each input");
+            std::vector<size_t> result;
+            for (const grid_axis_t &axis : axes)
+                result.push_back(axis.size());
+            return result;
+        }
+        arrayn_t<Y, dimension>                          data_;
+        std::shared_ptr<const std::vector<grid_axis_t>> axes_;
+    };
 }
+
+#include "iccpp_clut_kernels.h"
 #endif
@@ -0,0 +1,307 @@
+#ifndef iccpp_clut_kernels_H
+#define iccpp_clut_kernels_H
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "iccpp_clut.h"
+#if defined(__AVX__)
+#include <immintrin.h>
+#define ICCPP_CLUT_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ICCPP_CLUT_SSE2
+#endif
+
+/**
+    @file
+    @brief Specialized span kernels for lut_t, selected through lut_kernel_t
+
+    The vertices of 4 outputs (CMYK) are combined with AVX when the compiler targets
+    it (-mavx, /arch:AVX, or the ICCPP_AVX option of CMake), otherwise with SSE2, 
+    which every x86-64 compiler targets.
+*/
+namespace iccpp
+{
+    /// instruction set of the vector combine of the kernels, "avx", "sse2" or "none"
+#if defined(ICCPP_CLUT_AVX)
+    const char *const clut_kernel_isa = "avx";
+#elif defined(ICCPP_CLUT_SSE2)
+    const char *const clut_kernel_isa = "sse2";
+#else
+    const char *const clut_kernel_isa = "none";
+#endif
+
+    ///
+    /// @brief Order of the axes in a simplex, as a table indexed by the outcome of the
+    ///        comparisons of the fractional parts: a bit is set when f[i] >= f[j], for
+    ///        each pair i < j. Built on first use, shared by all the tables.
+    ///
+    template <int N>
+    struct simplex_order_t
+    {
+        enum { pairs = N * (N - 1) / 2, codes = 1 << pairs };
+        static const simplex_order_t &instance(void)
+        {
+            static const simplex_order_t order; // thread safe initialization
+            return order;
+        }
+        // position of pair (i, j), i < j, in the code
+        static constexpr size_t bit(size_t i, size_t j)
+        {
+            return i * N - i * (i + 1) / 2 + j - i - 1;
+        }
+        unsigned char axis[codes][N]; ///< axes by decreasing fractional part
+    private:
+        simplex_order_t(void)
+        {
+            for (size_t c = 0; c < codes; c++)
+            {
+                size_t rank[N] = {}; // number of axes beaten
+                for (size_t i = 0; i < N; i++)
+                    for (size_t j = i + 1; j < N; j++)
+                        rank[(c >> bit(i, j)) & 1 ? i : j]++;
+                size_t order[N];
+                for (size_t i = 0; i < N; i++)
+                    order[i] = i;
+                // codes not produced by any input (cycles) get some order too
+                std::stable_sort(order, order + N, [&rank](size_t l, size_t r) { return rank[l] > rank[r]; });
+                for (size_t i = 0; i < N; i++)
+                    axis[c][i] = static_cast<unsigned char>(order[i]);
+            }
+        }
+    };
+
+    ///
+    /// @brief Tetrahedral interpolation in 3 dimensions with M outputs.
+    ///        Values are processed in blocks: a first pass finds for each value the cell,
+    ///        the tetrahedron (through the simplex_order_t<3> table indexed by the 
+    ///        comparisons of the fractional parts, so without branches) and the weights;
+    ///        a second pass combines the four vertices of each value, with AVX or SSE2
+    ///        across the outputs when M == 4.
+    ///        Axes maps coordinates to cells, see lut_axes_t and fixed_grid_axes_t.
+    ///
+    template <int M>
+    struct tetra3_kernel_t
+    {
+        enum { block = 64 };
+        typedef vector_t<double, M> vertex_t;
+
+        template <class Axes>
+        static void eval_n(const arrayn_t<vertex_t, 3> &table, const Axes &axes,
+                           const vector_t<double, 3> *x, vertex_t *y, size_t n)
+        {
+            const size_t *offset = table.offset();
+            const vertex_t *data = table.data();
+            // tetrahedron of each code of simplex_order_t<3>, as offsets of its vertices
+            const simplex_order_t<3> &order = simplex_order_t<3>::instance();
+            size_t first[8];
+            size_t second[8];
+            for (size_t code = 0; code < 8; code++)
+            {
+                first[code] = offset[order.axis[code][0]];
+                second[code] = first[code] + offset[order.axis[code][1]];
+            }
+            const size_t last = offset[0] + offset[1] + offset[2];
+
+            size_t vertex[block][3];
+            double weight[block][4];
+            for (size_t i = 0; i < n; i += block)
+            {
+                size_t m = std::min(n - i, static_cast<size_t>(block));
+                for (size_t j = 0; j < m; j++)
+                {
+                    const double *src = x[i + j].data();
+                    double f[3];
+                    size_t base = 0;
+                    for (size_t k = 0; k < 3; k++)
+                    {
+                        base += axes.cell(src[k], k, f[k]) * offset[k];
+                    }
+                    // bits as in simplex_order_t<3>::bit
+                    size_t code = (f[0] >= f[1]) | (f[0] >= f[2]) << 1 | (f[1] >= f[2]) << 2;
+                    const unsigned char *axis = order.axis[code];
+                    double d1 = f[axis[0]];
+                    double d2 = f[axis[1]];
+                    double d3 = f[axis[2]];
+                    vertex[j][0] = base;
+                    vertex[j][1] = base + first[code];
+                    vertex[j][2] = base + second[code];
+                    weight[j][0] = 1.0 - d1;
+                    weight[j][1] = d1 - d2;
+                    weight[j][2] = d2 - d3;
+                    weight[j][3] = d3;
+                }
+                for (size_t j = 0; j < m; j++)
+                    combine(data + vertex[j][0], data + vertex[j][1], data + vertex[j][2], 
+                            data + vertex[j][0] + last, weight[j], y[i + j].data());
+            }
+        }
+        static void combine(const vertex_t *c0, const vertex_t *c1, const vertex_t *c2, const vertex_t *c3,
+                            const double *w, double *dest)
+        {
+            for (int k = 0; k < M; k++)
+                dest[k] = (*c0)[k] * w[0] + (*c1)[k] * w[1] + (*c2)[k] * w[2] + (*c3)[k] * w[3];
+        }
+    };
+
+#if defined(ICCPP_CLUT_AVX)
+    template <>
+    inline void tetra3_kernel_t<4>::combine(const vertex_t *c0, const vertex_t *c1, const vertex_t *c2, const vertex_t *c3,
+                                            const double *w, double *dest)
+    {
+        __m256d result = _mm256_mul_pd(_mm256_loadu_pd(c0->data()), _mm256_set1_pd(w[0]));
+        result = _mm256_add_pd(result, _mm256_mul_pd(_mm256_loadu_pd(c1->data()), _mm256_set1_pd(w[1])));
+        result = _mm256_add_pd(result, _mm256_mul_pd(_mm256_loadu_pd(c2->data()), _mm256_set1_pd(w[2])));
+        result = _mm256_add_pd(result, _mm256_mul_pd(_mm256_loadu_pd(c3->data()), _mm256_set1_pd(w[3])));
+        _mm256_storeu_pd(dest, result);
+    }
+#elif defined(ICCPP_CLUT_SSE2)
+    // the 4 outputs as two pairs, vertices added in the order of the scalar code
+    template <>
+    inline void tetra3_kernel_t<4>::combine(const vertex_t *c0, const vertex_t *c1, const vertex_t *c2, const vertex_t *c3,
+                                            const double *w, double *dest)
+    {
+        const vertex_t *c[4] = { c0, c1, c2, c3 };
+        __m128d low = _mm_setzero_pd();
+        __m128d high = _mm_setzero_pd();
+        for (int v = 0; v < 4; v++)
+        {
+            __m128d weight = _mm_set1_pd(w[v]);
+            low = _mm_add_pd(low, _mm_mul_pd(_mm_loadu_pd(c[v]->data()), weight));
+            high = _mm_add_pd(high, _mm_mul_pd(_mm_loadu_pd(c[v]->data() + 2), weight));
+        }
+        _mm_storeu_pd(dest, low);
+        _mm_storeu_pd(dest + 2, high);
+    }
+#endif
+
+    ///
+    /// @brief Simplex interpolation in 4 dimensions (CMYK) with M outputs, same two
+    ///        passes as tetra3_kernel_t. The simplex comes from the shared
+    ///        simplex_order_t<4> table, indexed by the six comparisons of the
+    ///        fractional parts; vertices are reached adding the offsets of the axes in
+    ///        that order. Results are the same as the ones of arrayn_t::combine.
+    ///
+    template <int M>
+    struct tetra4_kernel_t
+    {
+        enum { block = 64 };
+        typedef vector_t<double, M> vertex_t;
+        typedef simplex_order_t<4> order_t;
+
+        template <class Axes>
+        static void eval_n(const arrayn_t<vertex_t, 4> &table, const Axes &axes,
+                           const vector_t<double, 4> *x, vertex_t *y, size_t n)
+        {
+            const size_t *offset = table.offset();
+            const vertex_t *data = table.data();
+            const order_t &order = order_t::instance();
+            const size_t last = offset[0] + offset[1] + offset[2] + offset[3];
+
+            size_t vertex[block][4];
+            double weight[block][5];
+            for (size_t i = 0; i < n; i += block)
+            {
+                size_t m = std::min(n - i, static_cast<size_t>(block));
+                for (size_t j = 0; j < m; j++)
+                {
+                    const double *src = x[i + j].data();
+                    double f[4];
+                    size_t base = 0;
+                    for (size_t k = 0; k < 4; k++)
+                    {
+                        base += axes.cell(src[k], k, f[k]) * offset[k];
+                    }
+                    // bits as in simplex_order_t<4>::bit
+                    size_t code = (f[0] >= f[1]) | (f[0] >= f[2]) << 1 | (f[0] >= f[3]) << 2 |
+                                  (f[1] >= f[2]) << 3 | (f[1] >= f[3]) << 4 | (f[2] >= f[3]) << 5;
+                    const unsigned char *axis = order.axis[code];
+                    double d1 = f[axis[0]];
+                    double d2 = f[axis[1]];
+                    double d3 = f[axis[2]];
+                    double d4 = f[axis[3]];
+                    vertex[j][0] = base;
+                    vertex[j][1] = vertex[j][0] + offset[axis[0]];
+                    vertex[j][2] = vertex[j][1] + offset[axis[1]];
+                    vertex[j][3] = vertex[j][2] + offset[axis[2]];
+                    weight[j][0] = 1.0 - d1;
+                    weight[j][1] = d1 - d2;
+                    weight[j][2] = d2 - d3;
+                    weight[j][3] = d3 - d4;
+                    weight[j][4] = d4;
+                }
+                for (size_t j = 0; j < m; j++)
+                    combine(data + vertex[j][0], data + vertex[j][1], data + vertex[j][2], data + vertex[j][3],
+                            data + vertex[j][0] + last, weight[j], y[i + j].data());
+            }
+        }
+        static void combine(const vertex_t *c0, const vertex_t *c1, const vertex_t *c2, const vertex_t *c3,
+                            const vertex_t *c4, const double *w, double *dest)
+        {
+            for (int k = 0; k < M; k++)
+                dest[k] = (*c0)[k] * w[0] + (*c1)[k] * w[1] + (*c2)[k] * w[2] + (*c3)[k] * w[3] + (*c4)[k] * w[4];
+        }
+    };
+
+#if defined(ICCPP_CLUT_AVX)
+    template <>
+    inline void tetra4_kernel_t<4>::combine(const vertex_t *c0, const vertex_t *c1, const vertex_t *c2, const vertex_t *c3,
+                                            const vertex_t *c4, const double *w, double *dest)
+    {
+        __m256d result = _mm256_mul_pd(_mm256_loadu_pd(c0->data()), _mm256_set1_pd(w[0]));
+        result = _mm256_add_pd(result, _mm256_mul_pd(_mm256_loadu_pd(c1->data()), _mm256_set1_pd(w[1])));
+        result = _mm256_add_pd(result, _mm256_mul_pd(_mm256_loadu_pd(c2->data()), _mm256_set1_pd(w[2])));
+        result = _mm256_add_pd(result, _mm256_mul_pd(_mm256_loadu_pd(c3->data()), _mm256_set1_pd(w[3])));
+        result = _mm256_add_pd(result, _mm256_mul_pd(_mm256_loadu_pd(c4->data()), _mm256_set1_pd(w[4])));
+        _mm256_storeu_pd(dest, result);
+    }
+#elif defined(ICCPP_CLUT_SSE2)
+    template <>
+    inline void tetra4_kernel_t<4>::combine(const vertex_t *c0, const vertex_t *c1, const vertex_t *c2, const vertex_t *c3,
+                                            const vertex_t *c4, const double *w, double *dest)
+    {
+        const vertex_t *c[5] = { c0, c1, c2, c3, c4 };
+        __m128d low = _mm_setzero_pd();
+        __m128d high = _mm_setzero_pd();
+        for (int v = 0; v < 5; v++)
+        {
+            __m128d weight = _mm_set1_pd(w[v]);
+            low = _mm_add_pd(low, _mm_mul_pd(_mm_loadu_pd(c[v]->data()), weight));
+            high = _mm_add_pd(high, _mm_mul_pd(_mm_loadu_pd(c[v]->data() + 2), weight));
+        }
+        _mm_storeu_pd(dest, low);
+        _mm_storeu_pd(dest + 2, high);
+    }
+#endif
+
+    template <int M>
+    struct lut_kernel_t<vector_t<double, M>, vector_t<double, 3>, interp_tetra_t>
+    {
+        template <class Axes>
+        static bool eval_n(const arrayn_t<vector_t<double, M>, 3> &table, const Axes &axes,
+                           const vector_t<double, 3> *x, vector_t<double, M> *y, size_t n)
+        {
+            tetra3_kernel_t<M>::eval_n(table, axes, x, y, n);
+            return true;
+        }
+    };
+
+    template <int M>
+    struct lut_kernel_t<vector_t<double, M>, vector_t<double, 4>, interp_tetra_t>
+    {
+        template <class Axes>
+        static bool eval_n(const arrayn_t<vector_t<double, M>, 4> &table, const Axes &axes,
+                           const vector_t<double, 4> *x, vector_t<double, M> *y, size_t n)
+        {
+            tetra4_kernel_t<M>::eval_n(table, axes, x, y, n);
+            return true;
+        }
+    };
+}
+#endif
@@ -15,6 +15,8 @@
 #include "iccpp_traits.h"
 #include "iccpp_rgb.h"
 #include <math.h>
+#include <cstdint>
+#include <cstring>
 
 //
 // definition of some common color spaces and conversion between them
@@ -24,6 +26,8 @@ namespace iccpp
 
     struct xyz_t
     {
+        using scalar_type = double;
+        enum { dimension = 3 };
         double x;
         double y;
         double z;
@@ -34,6 +38,8 @@ namespace iccpp
 
     struct lab_t
     {
+        using scalar_type = double;
+        enum { dimension = 3 };
         double L;
         double a;
         double b;
@@ -54,27 +60,60 @@ namespace iccpp
         typedef domain_null_t domain_t;
     };
     ///
-    /// @brief xyz -> Lab conversion
+    /// @brief Fusion rule for conversions that are inverse one of the other up to
+    ///        rounding: color_conversion_t<Y, X> applied after color_conversion_t<X, Y>
+    ///        is replaced by an identity. The rgb and xyz data interpretations are exact,
+    ///        the round trip through the Lab encoding (scale by 100 and 255, offset 128)
+    ///        is not, and results change at the ULP level.
+    ///
+    template <class Y, class X>
+    algo_base_t *fuse_inverse(const algo_base_t &prev)
+    {
+        if (dynamic_cast<const color_conversion_t<X, Y> *>(&prev) != nullptr)
+            return new identity_t<Y>;
+        return nullptr;
+    }
+    ///
+    /// @brief Cube root of t > 0 used by the Lab conversions, about 3 times faster
+    ///        than pow(t, 1 / 3.0) and within 1e-15 relative error from it:
+    ///        exponent divided by 3 on the bit pattern, two Halley steps and a
+    ///        final Newton step
+    ///
+    inline double lab_cbrt(double t)
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &t, sizeof(bits));
+        bits = bits / 3 + 0x2A9F7893782DA1CEULL;
+        double y;
+        std::memcpy(&y, &bits, sizeof(y));
+        for (int i = 0; i < 2; i++)
+        {
+            double y3 = y * y * y;
+            y *= (y3 + 2 * t) / (2 * y3 + t);
+        }
+        return (2 * y + t / (y * y)) * (1 / 3.0);
+    }
+    ///
+    /// @brief xyz -> Lab conversion. The cube root of Y is shared by L and a, b
     ///
     template <>
-    class color_conversion_t<lab_t, xyz_t> : public algo_t<lab_t, xyz_t>
+    class color_conversion_t<lab_t, xyz_t>
+        : public algo_span_t<color_conversion_t<lab_t, xyz_t>, lab_t, xyz_t>
     {
     public:
         typedef xyz_t domain_t;
-        color_conversion_t<lab_t, xyz_t>(const xyz_t &white = xyz_t::D65()) : white_(white) {}
+        color_conversion_t<lab_t, xyz_t>(const xyz_t &white = xyz_t::D65()) : 
+            white_(white), inverse_{ 1 / white.x, 1 / white.y, 1 / white.z } {}
         virtual lab_t eval(const xyz_t &xyz) const override
         {
             lab_t result;
             const double thrs = 0.008856;
 
-            double t = xyz.y / white_.y;
-            if (t > thrs)
-                result.L = 116 * pow(t, 1 / 3.0) - 16;
-            else
-                result.L = 903.3 * t;
+            double t = xyz.y * inverse_.y;
             double ft = f(t);
-            result.a = 500 * (f(xyz.x / white_.x) - ft);
-            result.b = 200 * (ft - f(xyz.z / white_.z));
+            result.L = (t > thrs ? 116 * ft - 16 : 903.3 * t);
+            result.a = 500 * (f(xyz.x * inverse_.x) - ft);
+            result.b = 200 * (ft - f(xyz.z * inverse_.z));
             return result;
         }
         virtual color_conversion_t<lab_t, xyz_t> *clone(void) const override
@@ -82,20 +121,19 @@ namespace iccpp
             return new color_conversion_t<lab_t, xyz_t>(white_);
         }
     private:
-        double f(double t) const
+        static double f(double t)
         {
             const double thrs = 0.008856;
-            if (t > thrs)
-                return pow(t, 1 / 3.0);
-            else
-                return 7.787 * t + 16.0 / 116;
+            return (t > thrs ? lab_cbrt(t) : 7.787 * t + 16.0 / 116);
         }
         xyz_t white_;
+        xyz_t inverse_;
     };
     using xyz2lab_t = color_conversion_t<lab_t, xyz_t>;
 
     template <>
-    class color_conversion_t<xyz_t, lab_t> : public algo_t<xyz_t, lab_t>
+    class color_conversion_t<xyz_t, lab_t>
+        : public algo_span_t<color_conversion_t<xyz_t, lab_t>, xyz_t, lab_t>
     {
     public:
         typedef lab_t domain_t;
@@ -103,11 +141,13 @@ namespace iccpp
         virtual xyz_t eval(const lab_t &lab) const override
         {
             xyz_t result;
-            double P = (lab.L + 16.0) / 116;
+            double P = (lab.L + 16.0) * (1 / 116.0);
+            double X = P + lab.a * (1 / 500.0);
+            double Z = P - lab.b * (1 / 200.0);
 
-            result.x = white_.x * pow(P + lab.a / 500, 3);
-            result.y = white_.y * pow(P, 3);
-            result.z = white_.z * pow(P - lab.b / 200, 3);
+            result.x = white_.x * (X * X * X);
+            result.y = white_.y * (P * P * P);
+            result.z = white_.z * (Z * Z * Z);
 
             return result;
         }
@@ -130,7 +170,8 @@ namespace iccpp
 
     /// @brief rgb_t<T> -> xyz_t conversion assuming D65 white point
     template <class S>
-    class color_conversion_t<rgb_t<S>, xyz_t> : public algo_t<rgb_t<S>, xyz_t>
+    class color_conversion_t<rgb_t<S>, xyz_t>
+        : public algo_span_t<color_conversion_t<rgb_t<S>, xyz_t>, rgb_t<S>, xyz_t>
     {
     public:
         typedef xyz_t domain_t;
@@ -168,7 +209,8 @@ namespace iccpp
 
     /// @brief xyz_t -> rgb_t<T> conversion assuming D65 white point
     template <class S>
-    class color_conversion_t<xyz_t, rgb_t<S>> : public algo_t<xyz_t, rgb_t<S>>
+    class color_conversion_t<xyz_t, rgb_t<S>>
+        : public algo_span_t<color_conversion_t<xyz_t, rgb_t<S>>, xyz_t, rgb_t<S>>
     {
     public:
         typedef rgb_t<S> domain_t;
@@ -212,7 +254,8 @@ namespace iccpp
     
     /// @brief This conversion is more a data interpretation rule
     template <>
-    class color_conversion_t<rgb_t<double>, vector_t<double, 3>> : public algo_t<rgb_t<double>, vector_t<double, 3>>
+    class color_conversion_t<rgb_t<double>, vector_t<double, 3>>
+        : public algo_span_t<color_conversion_t<rgb_t<double>, vector_t<double, 3>>, rgb_t<double>, vector_t<double, 3>>
     {
     public:
         typedef vector_t<double, 3> domain_t;
@@ -229,11 +272,16 @@ namespace iccpp
         {
             return new color_conversion_t<rgb_t<double>, vector_t<double, 3>>;
         }
+        virtual algo_base_t *fuse(const algo_base_t &prev) const override
+        {
+            return fuse_inverse<rgb_t<double>, vector_t<double, 3>>(prev);
+        }
     };
 
     /// @brief This conversion is more a data interpretation rule
     template <>
-    class color_conversion_t<vector_t<double, 3>, rgb_t<double>> : public algo_t<vector_t<double, 3>, rgb_t<double>>
+    class color_conversion_t<vector_t<double, 3>, rgb_t<double>>
+        : public algo_span_t<color_conversion_t<vector_t<double, 3>, rgb_t<double>>, vector_t<double, 3>, rgb_t<double>>
     {
     public:
         typedef rgb_t<double> domain_t;
@@ -250,13 +298,18 @@ namespace iccpp
         {
             return new color_conversion_t<vector_t<double, 3>, rgb_t<double>>;
         }
+        virtual algo_base_t *fuse(const algo_base_t &prev) const override
+        {
+            return fuse_inverse<vector_t<double, 3>, rgb_t<double>>(prev);
+        }
     };
 
     /// @brief Conversion between rgb typed based on different channel type
     /// Scaling to one (255) is done for unsigned char channel
     ///
     template <class S, class T>
-    class color_conversion_t<rgb_t<S>, rgb_t<T>> : public algo_t<rgb_t<S>, rgb_t<T>>
+    class color_conversion_t<rgb_t<S>, rgb_t<T>>
+        : public algo_span_t<color_conversion_t<rgb_t<S>, rgb_t<T>>, rgb_t<S>, rgb_t<T>>
     {
     public:
         typedef rgb_t<T> domain_t;
@@ -279,7 +332,8 @@ namespace iccpp
     /// Scaling to one (255) is done for unsigned char channel
     ///
     template <class S, class T>
-    class color_conversion_t<bgr_t<S>, bgr_t<T>> : public algo_t<bgr_t<S>, bgr_t<T>>
+    class color_conversion_t<bgr_t<S>, bgr_t<T>>
+        : public algo_span_t<color_conversion_t<bgr_t<S>, bgr_t<T>>, bgr_t<S>, bgr_t<T>>
     {
     public:
         typedef bgr_t<T> domain_t;
@@ -302,7 +356,8 @@ namespace iccpp
     /// Scaling to one (255) is done for unsigned char channel
     ///
     template <class S, class T>
-    class color_conversion_t<rgb_t<S>, bgr_t<T>> : public algo_t<rgb_t<S>, bgr_t<T>>
+    class color_conversion_t<rgb_t<S>, bgr_t<T>>
+        : public algo_span_t<color_conversion_t<rgb_t<S>, bgr_t<T>>, rgb_t<S>, bgr_t<T>>
     {
     public:
         typedef bgr_t<T> domain_t;
@@ -310,9 +365,9 @@ namespace iccpp
         {
             rgb_t<S> result;
 
-            result.red   = static_cast<S>(rgb.red   * scalar_traits_t<S>::one / scalar_traits_t<T>::one);
-            result.green = static_cast<S>(rgb.green * scalar_traits_t<S>::one / scalar_traits_t<T>::one);
-            result.blue  = static_cast<S>(rgb.blue  * scalar_traits_t<S>::one / scalar_traits_t<T>::one);
+            result.red   = static_cast<S>(rgb.red   * scalar_traits_t<S>::one() / scalar_traits_t<T>::one());
+            result.green = static_cast<S>(rgb.green * scalar_traits_t<S>::one() / scalar_traits_t<T>::one());
+            result.blue  = static_cast<S>(rgb.blue  * scalar_traits_t<S>::one() / scalar_traits_t<T>::one());
             return result;
         }
         virtual color_conversion_t<rgb_t<S>, bgr_t<T>> *clone(void) const override
@@ -322,7 +377,8 @@ namespace iccpp
     };
 
     template <class S, class T>
-    class color_conversion_t<bgr_t<S>, rgb_t<T>> : public algo_t<bgr_t<S>, rgb_t<T>>
+    class color_conversion_t<bgr_t<S>, rgb_t<T>>
+        : public algo_span_t<color_conversion_t<bgr_t<S>, rgb_t<T>>, bgr_t<S>, rgb_t<T>>
     {
     public:
         typedef rgb_t<T> domain_t;
@@ -330,9 +386,9 @@ namespace iccpp
         {
             bgr_t<S> result;
 
-            result.red   = static_cast<S>(rgb.red   * scalar_traits_t<S>::one / scalar_traits_t<T>::one);
-            result.green = static_cast<S>(rgb.green * scalar_traits_t<S>::one / scalar_traits_t<T>::one);
-            result.blue  = static_cast<S>(rgb.blue  * scalar_traits_t<S>::one / scalar_traits_t<T>::one);
+            result.red   = static_cast<S>(rgb.red   * scalar_traits_t<S>::one() / scalar_traits_t<T>::one());
+            result.green = static_cast<S>(rgb.green * scalar_traits_t<S>::one() / scalar_traits_t<T>::one());
+            result.blue  = static_cast<S>(rgb.blue  * scalar_traits_t<S>::one() / scalar_traits_t<T>::one());
             return result;
         }
         virtual color_conversion_t<bgr_t<S>, rgb_t<T>> *clone(void) const override
@@ -342,7 +398,8 @@ namespace iccpp
     };
 
     template <>
-    class color_conversion_t<xyz_t, vector_t<double, 3>> : public algo_t<xyz_t, vector_t<double, 3>>
+    class color_conversion_t<xyz_t, vector_t<double, 3>>
+        : public algo_span_t<color_conversion_t<xyz_t, vector_t<double, 3>>, xyz_t, vector_t<double, 3>>
     {
     public:
         typedef vector_t<double, 3> domain_t;
@@ -359,11 +416,16 @@ namespace iccpp
         {
             return new color_conversion_t<xyz_t, vector_t<double, 3>>;
         }
+        virtual algo_base_t *fuse(const algo_base_t &prev) const override
+        {
+            return fuse_inverse<xyz_t, vector_t<double, 3>>(prev);
+        }
     };
 
     /// @brief This conversion is more a data interpretation rule
     template <>
-    class color_conversion_t<vector_t<double, 3>, xyz_t> : public algo_t<vector_t<double, 3>, xyz_t>
+    class color_conversion_t<vector_t<double, 3>, xyz_t>
+        : public algo_span_t<color_conversion_t<vector_t<double, 3>, xyz_t>, vector_t<double, 3>, xyz_t>
     {
     public:
         typedef xyz_t domain_t;
@@ -380,11 +442,16 @@ namespace iccpp
         {
             return new color_conversion_t<vector_t<double, 3>, xyz_t>;
         }
+        virtual algo_base_t *fuse(const algo_base_t &prev) const override
+        {
+            return fuse_inverse<vector_t<double, 3>, xyz_t>(prev);
+        }
     };
 
     /// @brief This conversion is an encoding rule
     template <>
-    class color_conversion_t<lab_t, vector_t<double, 3>> : public algo_t<lab_t, vector_t<double, 3>>
+    class color_conversion_t<lab_t, vector_t<double, 3>>
+        : public algo_span_t<color_conversion_t<lab_t, vector_t<double, 3>>, lab_t, vector_t<double, 3>>
     {
     public:
         typedef vector_t<double, 3> domain_t;
@@ -401,10 +468,15 @@ namespace iccpp
         {
             return new color_conversion_t<lab_t, vector_t<double, 3>>;
         }
+        virtual algo_base_t *fuse(const algo_base_t &prev) const override
+        {
+            return fuse_inverse<lab_t, vector_t<double, 3>>(prev);
+        }
     };
 
     template <>
-    class color_conversion_t<vector_t<double, 3>, lab_t> : public algo_t<vector_t<double, 3>, lab_t>
+    class color_conversion_t<vector_t<double, 3>, lab_t>
+        : public algo_span_t<color_conversion_t<vector_t<double, 3>, lab_t>, vector_t<double, 3>, lab_t>
     {
     public:
         typedef lab_t domain_t;
@@ -412,20 +484,25 @@ namespace iccpp
         {
             vector_t<double, 3> result;
 
-            result[0] = lab.L / 100;
-            result[1] = (lab.a + 128.0) / 255.0;
-            result[2] = (lab.b + 128.0) / 255.0;
+            result[0] = lab.L * (1 / 100.0);
+            result[1] = (lab.a + 128.0) * (1 / 255.0);
+            result[2] = (lab.b + 128.0) * (1 / 255.0);
             return result;
         }
         virtual color_conversion_t<vector_t<double, 3>, lab_t> *clone(void) const override
         {
             return new color_conversion_t<vector_t<double, 3>, lab_t>;
         }
+        virtual algo_base_t *fuse(const algo_base_t &prev) const override
+        {
+            return fuse_inverse<vector_t<double, 3>, lab_t>(prev);
+        }
     };
 
 
     template <class S, class T, int N>
-    class color_conversion_t<vector_t<S, N>, vector_t<T, N>> : public algo_t<vector_t<S, N>, vector_t<T, N>>
+    class color_conversion_t<vector_t<S, N>, vector_t<T, N>>
+        : public algo_span_t<color_conversion_t<vector_t<S, N>, vector_t<T, N>>, vector_t<S, N>, vector_t<T, N>>
     {
     public:
         typedef vector_t<T, N> domain_t;
@@ -11,6 +11,8 @@
 //
 #include "iccpp_typelist.h"
 #include "iccpp_color_spaces.h"
+#include "iccpp_lut_funct.h"
+#include "iccpp_fixed_lut.h"
 
 /**
   @file
@@ -331,12 +333,20 @@ namespace iccpp
         std::shared_ptr<algo_base_t> result_;
     };
 
+    template <class Y, class X, bool>
+    struct fixed_compiler_t;
+
     class transform_t
     {
     public:
         template <class Y, class X>
-        static std::shared_ptr<algo_t<Y, X>> create(std::shared_ptr<algo_base_t> output, std::shared_ptr<algo_base_t> input)
+        static std::shared_ptr<algo_t<Y, X>> create(std::shared_ptr<algo_base_t> output, 
+                                                    std::shared_ptr<algo_base_t> input,
+                                                    const transform_options_t &options = transform_options_t())
         {
+            const bool fixed = fixed_pixel_t<Y>::value && fixed_pixel_t<X>::value;
+            if (options.fixed_point && fixed)
+                return fixed_compiler_t<Y, X, fixed>::create(output, input, options);
             std::shared_ptr<algo_t<Y, X>> result;
             std::shared_ptr<algo_base_t> algo(create_joined(output, input));
             if (algo)
@@ -349,6 +359,8 @@ namespace iccpp
                 }
 
             }
+            if (result)
+                result = apply_options(function_t<Y, X>(result), options).imp();
             return result;
         }
     private:
@@ -368,6 +380,42 @@ namespace iccpp
         }
     };
 
+    template <class Y, class X, bool>
+    struct fixed_compiler_t
+    {
+        static std::shared_ptr<algo_t<Y, X>> create(std::shared_ptr<algo_base_t>, std::shared_ptr<algo_base_t>,
+                                                    const transform_options_t &)
+        {
+            return nullptr;
+        }
+    };
+
+    // the transform is built on floating point pixels, then sampled in fixed point
+    template <class Y, class X>
+    struct fixed_compiler_t<Y, X, true>
+    {
+        static std::shared_ptr<algo_t<Y, X>> create(std::shared_ptr<algo_base_t> output, std::shared_ptr<algo_base_t> input,
+                                                    const transform_options_t &options)
+        {
+            typedef typename channel_traits_t<Y>::template rebind<double> real_range_t;
+            typedef typename channel_traits_t<X>::template rebind<double> real_domain_t;
+            std::shared_ptr<algo_t<real_range_t, real_domain_t>> real(
+                transform_t::create<real_range_t, real_domain_t>(output, input, transform_options_t(true)));
+            if (!real)
+                return nullptr;
+            // the grid is the one of a floating point table within max_error, the 
+            // largest one when out of reach; it is found by sampling f, no table is built.
+            // As for lut_t, one unit of output rounding per channel is allowed on top
+            typedef typename channel_traits_t<Y>::scalar_type output_type;
+            const double rounding = static_cast<double>(channel_traits_t<Y>::channels) / 
+                                    std::numeric_limits<output_type>::max();
+            function_t<real_range_t, real_domain_t> f(real);
+            size_t grid = 0;
+            lut_grid_within(f, options.max_error + rounding, &grid);
+            return make_fixed_lut<Y, X>(f, grid).imp();
+        }
+    };
+
 }
 
 #endif
@@ -10,14 +10,37 @@
 // http://www.boost.org/LICENSE_1_0.txt)
 //
 #include <vector>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <algorithm>
 #include "iccpp_function.h"
+#include "iccpp_pixel.h"
 
 /**
     @file
     @brief This file some algorithms (curves, 1D Lut) defined by an ICC profile
 */
+#ifndef LOG_PIXEL
+#define LOG_PIXEL(text, x)
+#endif
+
 namespace iccpp
 {
+    ///
+    /// @brief Fusion of curves: number of knots used to resample two curves in a
+    ///        single one, and largest error accepted at the middle of the intervals
+    ///
+    const size_t fused_curve_knots = 4096;
+    const double fused_curve_tolerance = 1e-4;
+    ///
+    /// @brief Baking of curves: initial number of knots, and largest number tried
+    ///        before giving up when the error exceeds baked_curve_tolerance
+    ///
+    const size_t baked_curve_knots = 4096;
+    const size_t baked_curve_max_knots = 65536;
+    const double baked_curve_tolerance = 1e-5;
+
     inline double clip01(double x)
     {
         return (x < 0.0 ? 0.0 : (x > 1.0 ? 1.0 : x));
@@ -25,7 +48,7 @@ namespace iccpp
     // 
     // These are functions generated by the loader
     //
-    class icc_gamma_curve_t : public algo_t<double, double>
+    class icc_gamma_curve_t : public algo_span_t<icc_gamma_curve_t, double, double>
     {
     public:
         icc_gamma_curve_t(double gamma) : gamma_(gamma) {}
@@ -41,7 +64,7 @@ namespace iccpp
         double gamma_;
     };
 
-    class icc_curve_interpolated_t : public algo_t<double, double>
+    class icc_curve_interpolated_t : public algo_span_t<icc_curve_interpolated_t, double, double>
     {
     public:
         // add the way to move construct the vector
@@ -55,7 +78,7 @@ namespace iccpp
             int index = static_cast<int>(value / step_);
             if (index < 0)
                 return *knots_.begin();
-            else if (index + 1 == static_cast<int>(knots_.size()))
+            else if (index + 1 >= static_cast<int>(knots_.size()))
                 return *knots_.rbegin();
             else
             {
@@ -67,12 +90,13 @@ namespace iccpp
         {
             return new icc_curve_interpolated_t(knots_);
         }
+        const std::vector<double> &knots(void) const { return knots_; }
     private:
         std::vector<double> knots_; // should they be reference counted?
         double              step_;
     };
 
-    class icc_curve_parametric_t : public algo_t<double, double>
+    class icc_curve_parametric_t : public algo_span_t<icc_curve_parametric_t, double, double>
     {
     public:
         icc_curve_parametric_t(double g,
@@ -103,6 +127,71 @@ namespace iccpp
         double f_;
     };
 
+    ///
+    /// @class icc_curve_baked_t
+    /// @brief Curve sampled on a dense uniform table, linearly interpolated.
+    ///        Inputs are clipped to [0, 1]. Tables are shared by the clones.
+    ///
+    class icc_curve_baked_t : public algo_span_t<icc_curve_baked_t, double, double>
+    {
+    public:
+        explicit icc_curve_baked_t(const std::vector<double> &knots) : 
+            table_(std::make_shared<const std::vector<double>>(knots)), scale_(knots.size() - 1.0), last_(knots.size() - 1) {}
+        ///
+        /// @brief Samples curve on knots points. With 256 or 65536 knots the table
+        ///        holds the exact values of the curve for 8 and 16 bit inputs
+        ///
+        static icc_curve_baked_t *sample(const algo_t<double, double> &curve, size_t knots)
+        {
+            std::vector<double> table(knots);
+            for (size_t k = 0; k < knots; k++)
+                table[k] = curve.eval(k / (knots - 1.0));
+            return new icc_curve_baked_t(table);
+        }
+        double eval(const double &value) const override
+        {
+            const double *table = table_->data();
+            double t = clip01(value) * scale_;
+            size_t index = std::min(static_cast<size_t>(t), last_ - 1);
+            return table[index] + (t - index) * (table[index + 1] - table[index]);
+        }
+        virtual icc_curve_baked_t *clone(void) const override
+        {
+            return new icc_curve_baked_t(*this);
+        }
+        size_t size(void) const { return table_->size(); }
+    private:
+        std::shared_ptr<const std::vector<double>> table_;
+        double                                     scale_;
+        size_t                                     last_;
+    };
+
+    ///
+    /// @brief Bakes curve into a table: interpolated curves keep their knots,
+    ///        other curves are sampled on baked_curve_knots points, doubled until
+    ///        the error at the middle of the intervals is below tolerance.
+    ///        Returns nullptr if baked_curve_max_knots are not enough.
+    ///
+    inline icc_curve_baked_t *bake_curve(const algo_t<double, double> &curve, double tolerance = baked_curve_tolerance)
+    {
+        const icc_curve_interpolated_t *interpolated = dynamic_cast<const icc_curve_interpolated_t *>(&curve);
+        if (interpolated != nullptr)
+            return new icc_curve_baked_t(interpolated->knots());
+        for (size_t knots = baked_curve_knots; knots <= baked_curve_max_knots; knots *= 2)
+        {
+            std::unique_ptr<icc_curve_baked_t> result(icc_curve_baked_t::sample(curve, knots));
+            double error = 0.0;
+            for (size_t k = 0; k + 1 < knots && error <= tolerance; k++)
+            {
+                double x = (k + 0.5) / (knots - 1.0);
+                error = std::fabs(result->eval(x) - curve.eval(x));
+            }
+            if (error <= tolerance)
+                return result.release();
+        }
+        return nullptr;
+    }
+
     template <int Outputs, int Inputs>
     using algo_vect_t = algo_t<vector_t<double, Outputs>, vector_t<double, Inputs>>;
 
@@ -127,6 +216,53 @@ namespace iccpp
         {
             return new icc_curve_t<N>(*this);
         }
+        // curve after curve is merged into a single curve resampled on fused_curve_knots points,
+        // unless the error at the middle of the intervals exceeds fused_curve_tolerance
+        virtual algo_base_t *fuse(const algo_base_t &prev) const override
+        {
+            const icc_curve_t<N> *curve = dynamic_cast<const icc_curve_t<N> *>(&prev);
+            if (curve == nullptr)
+                return nullptr;
+            std::unique_ptr<algo_t<double, double>> fused[N];
+            for (int i = 0; i < N; i++)
+            {
+                std::vector<double> knots(fused_curve_knots);
+                for (size_t k = 0; k < knots.size(); k++)
+                    knots[k] = algo_[i]->eval(curve->algo_[i]->eval(k / (knots.size() - 1.0)));
+                fused[i].reset(new icc_curve_interpolated_t(knots));
+                for (size_t k = 0; k + 1 < knots.size(); k++)
+                {
+                    double x = (k + 0.5) / (knots.size() - 1.0);
+                    if (std::fabs(fused[i]->eval(x) - algo_[i]->eval(curve->algo_[i]->eval(x))) > fused_curve_tolerance)
+                        return nullptr;
+                }
+            }
+            algo_t<double, double> *components[N];
+            for (int i = 0; i < N; i++)
+                components[i] = fused[i].release();
+            return new icc_curve_t<N>(components);
+        }
+        // channel curves are replaced by tables where accurate enough
+        virtual algo_base_t *bake(void) const override
+        {
+            std::unique_ptr<algo_t<double, double>> baked[N];
+            bool changed = false;
+            for (int i = 0; i < N; i++)
+            {
+                if (!algo_[i]->is_identity() && dynamic_cast<const icc_curve_baked_t *>(algo_[i].get()) == nullptr)
+                    baked[i].reset(bake_curve(*algo_[i]));
+                if (baked[i])
+                    changed = true;
+                else
+                    baked[i].reset(algo_[i]->clone());
+            }
+            if (!changed)
+                return nullptr;
+            algo_t<double, double> *components[N];
+            for (int i = 0; i < N; i++)
+                components[i] = baked[i].release();
+            return new icc_curve_t<N>(components);
+        }
         vector_t<double, N> eval(const vector_t<double, N> &rhs) const override
         {
             vector_t<double, N> result;
@@ -135,12 +271,34 @@ namespace iccpp
             LOG_PIXEL(__FUNCTION__, result);
             return result;
         }
+        // every channel curve is fed a whole block of values
+        void eval_n(const vector_t<double, N> *x, vector_t<double, N> *y, size_t n) const override
+        {
+            double in[span_block_size];
+            double out[span_block_size];
+            for (size_t i = 0; i < n; i += span_block_size)
+            {
+                size_t m = std::min(n - i, span_block_size);
+                for (int c = 0; c < N; c++)
+                {
+                    for (size_t k = 0; k < m; k++)
+                        in[k] = x[i + k][c];
+                    algo_[c]->eval_n(in, out, m);
+                    for (size_t k = 0; k < m; k++)
+                        y[i + k][c] = out[k];
+                }
+            }
+        }
     private:
         std::unique_ptr<algo_t<double, double>> algo_[N];
     };
 
+    template <int Outputs, int Inputs, class M>
+    algo_base_t *fuse_matrix(const M &lhs, const algo_base_t &prev);
+
     template <int Outputs, int Inputs>
-    class icc_matrix_affine_t : public algo_vect_t<Outputs, Inputs>
+    class icc_matrix_affine_t : public algo_span_t<icc_matrix_affine_t<Outputs, Inputs>,
+                                                   vector_t<double, Outputs>, vector_t<double, Inputs>>
     {
     public:
         typedef double line_t[Inputs + 1];
@@ -159,6 +317,11 @@ namespace iccpp
         {
             return new icc_matrix_affine_t(matrix_);
         }
+        double coefficient(int i, int j) const { return matrix_[i][j]; } ///< j == Inputs gives the offset
+        virtual algo_base_t *fuse(const algo_base_t &prev) const override
+        {
+            return fuse_matrix<Outputs, Inputs>(*this, prev);
+        }
         virtual vector_t<double, Outputs> eval(const vector_t<double, Inputs> &x) const override
         {
             // TODO add clipping  [0,1] range
@@ -173,7 +336,8 @@ namespace iccpp
     };
 
     template <int Outputs, int Inputs>
-    class icc_matrix_linear_t : public algo_vect_t<Outputs, Inputs>
+    class icc_matrix_linear_t : public algo_span_t<icc_matrix_linear_t<Outputs, Inputs>,
+                                                   vector_t<double, Outputs>, vector_t<double, Inputs>>
     {
     public:
         typedef double line_t[Inputs];
@@ -192,6 +356,11 @@ namespace iccpp
         {
             return new icc_matrix_linear_t(matrix_);
         }
+        double coefficient(int i, int j) const { return j == Inputs ? 0.0 : matrix_[i][j]; }
+        virtual algo_base_t *fuse(const algo_base_t &prev) const override
+        {
+            return fuse_matrix<Outputs, Inputs>(*this, prev);
+        }
         virtual vector_t<double, Outputs> eval(const vector_t<double, Inputs> &x) const override
         {
             // TODO add clipping  [0,1] range
@@ -205,6 +374,29 @@ namespace iccpp
         double matrix_[Outputs][Inputs];
     };
 
+    ///
+    /// @brief Fusion rule for matrices: lhs applied after a square matrix
+    ///        (linear or affine) is the affine matrix given by their product
+    ///
+    template <int Outputs, int Inputs, class M>
+    algo_base_t *fuse_matrix(const M &lhs, const algo_base_t &prev)
+    {
+        const icc_matrix_affine_t<Inputs, Inputs> *affine = dynamic_cast<const icc_matrix_affine_t<Inputs, Inputs> *>(&prev);
+        const icc_matrix_linear_t<Inputs, Inputs> *linear = dynamic_cast<const icc_matrix_linear_t<Inputs, Inputs> *>(&prev);
+        if (affine == nullptr && linear == nullptr)
+            return nullptr;
+        std::unique_ptr<icc_matrix_affine_t<Outputs, Inputs>> result(new icc_matrix_affine_t<Outputs, Inputs>());
+        for (int i = 0; i < Outputs; i++)
+            for (int j = 0; j <= Inputs; j++)
+            {
+                double value = (j == Inputs ? lhs.coefficient(i, Inputs) : 0.0);
+                for (int k = 0; k < Inputs; k++)
+                    value += lhs.coefficient(i, k) * (affine ? affine->coefficient(k, j) : linear->coefficient(k, j));
+                (*result)[i][j] = value;
+            }
+        return result.release();
+    }
+
 
 }
 
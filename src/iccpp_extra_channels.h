@@ -0,0 +1,171 @@
+#ifndef iccpp_extra_channels_H
+#define iccpp_extra_channels_H
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include "iccpp_function.h"
+#include "iccpp_fixed_lut.h"
+
+/**
+    @file
+    @brief Transform of pixels carrying channels besides the colour ones (alpha, spots).
+
+    A pixel P is seen as the channels of a colour pixel C followed by extra channels,
+    e.g. rgba_t<T> over rgb_t<T>, or vector_t<T, 6> over vector_t<T, 4> for CMYK and
+    two spots. extra_channels_t wraps the colour transform: each block of pixels is split
+    in a buffer of colours on the stack, transformed by a single eval_n, and joined again
+    with the extra channels copied (rescaled if the channel types differ). Single pixels
+    go straight through eval.
+*/
+namespace iccpp
+{
+    ///
+    /// @brief How colour channels relate to alpha: straight, or premultiplied
+    ///        by the last extra channel
+    ///
+    enum class alpha_mode_t { straight, premultiplied };
+
+    ///
+    /// @brief Value of a fully saturated channel: the maximum of integer types, 1 otherwise
+    ///
+    template <class T>
+    double channel_unit(void)
+    {
+        return std::is_integral<T>::value ? static_cast<double>(std::numeric_limits<T>::max()) : 1.0;
+    }
+
+    template <class T>
+    T channel_cast(double value)
+    {
+        if (!std::is_integral<T>::value)
+            return static_cast<T>(value);
+        double unit = channel_unit<T>();
+        return static_cast<T>(value < 0.0 ? 0.0 : (value > unit ? unit : value + 0.5));
+    }
+
+    ///
+    /// @class extra_channels_t
+    /// @brief Applies a transform from X to Y to the colour channels of XA pixels,
+    ///        giving YA pixels whose extra channels are the ones of the input
+    ///
+    template <class YA, class XA, class Y, class X>
+    class extra_channels_t : public algo_t<YA, XA>
+    {
+    public:
+        typedef channel_traits_t<XA> in_traits_t;
+        typedef channel_traits_t<YA> out_traits_t;
+        enum
+        {
+            in_colors = channel_traits_t<X>::channels,
+            out_colors = channel_traits_t<Y>::channels,
+            extras = in_traits_t::channels - in_colors
+        };
+        static_assert(extras > 0 && extras == out_traits_t::channels - out_colors, "Extra channels do not match");
+
+        extra_channels_t(const function_t<Y, X> &f, alpha_mode_t mode = alpha_mode_t::straight) : f_(f), mode_(mode) {}
+        virtual YA eval(const XA &xa) const override
+        {
+            X x;
+            split(xa, x);
+            YA ya;
+            join(xa, f_.eval(x), ya);
+            return ya;
+        }
+        // colours go through blocks of span_block_size on the stack
+        virtual void eval_n(const XA *xa, YA *ya, size_t n) const override
+        {
+            X x[span_block_size];
+            Y y[span_block_size];
+            for (size_t i = 0; i < n; i += span_block_size)
+            {
+                size_t m = std::min(n - i, span_block_size);
+                for (size_t k = 0; k < m; k++)
+                    split(xa[i + k], x[k]);
+                f_.eval_n(x, y, m);
+                for (size_t k = 0; k < m; k++)
+                    join(xa[i + k], y[k], ya[i + k]);
+            }
+        }
+        virtual extra_channels_t<YA, XA, Y, X> *clone(void) const override
+        {
+            return new extra_channels_t<YA, XA, Y, X>(f_, mode_);
+        }
+        virtual void children(algo_base_t::stage_list_t &stages) const override
+        {
+            stages.push_back(f_.imp());
+        }
+    private:
+        typedef typename in_traits_t::scalar_type in_scalar_t;
+        typedef typename out_traits_t::scalar_type out_scalar_t;
+        typedef typename channel_traits_t<X>::scalar_type color_scalar_t;
+        typedef typename channel_traits_t<Y>::scalar_type result_scalar_t;
+        // colour channels of p, divided by alpha when premultiplied
+        void split(const XA &p, X &x) const
+        {
+            const double in_unit = channel_unit<in_scalar_t>();
+            const double color_unit = channel_unit<color_scalar_t>();
+            const bool premultiplied = (mode_ == alpha_mode_t::premultiplied);
+            double alpha = (premultiplied ? in_traits_t::get(p, in_traits_t::channels - 1) / in_unit : 1.0);
+            for (int c = 0; c < in_colors; c++)
+            {
+                if (!premultiplied && std::is_same<in_scalar_t, color_scalar_t>::value)
+                {
+                    channel_traits_t<X>::set(x, c, static_cast<color_scalar_t>(in_traits_t::get(p, c)));
+                    continue;
+                }
+                double value = in_traits_t::get(p, c) / in_unit;
+                if (premultiplied)
+                    value = (alpha > 0.0 ? value / alpha : 0.0);
+                channel_traits_t<X>::set(x, c, channel_cast<color_scalar_t>(value * color_unit));
+            }
+        }
+        // colour y with the extra channels of input into p
+        void join(const XA &input, const Y &y, YA &p) const
+        {
+            const double in_unit = channel_unit<in_scalar_t>();
+            const double out_unit = channel_unit<out_scalar_t>();
+            const bool premultiplied = (mode_ == alpha_mode_t::premultiplied);
+            // extras are read before the colour is written, input and p may be the same storage
+            in_scalar_t extra[extras];
+            for (int e = 0; e < extras; e++)
+                extra[e] = in_traits_t::get(input, in_colors + e);
+            double alpha = (premultiplied ? extra[extras - 1] / in_unit : 1.0);
+            for (int c = 0; c < out_colors; c++)
+            {
+                if (!premultiplied && std::is_same<out_scalar_t, result_scalar_t>::value)
+                {
+                    out_traits_t::set(p, c, static_cast<out_scalar_t>(channel_traits_t<Y>::get(y, c)));
+                    continue;
+                }
+                double value = channel_traits_t<Y>::get(y, c) / channel_unit<result_scalar_t>();
+                out_traits_t::set(p, c, channel_cast<out_scalar_t>(value * alpha * out_unit));
+            }
+            for (int e = 0; e < extras; e++)
+                if (std::is_same<in_scalar_t, out_scalar_t>::value)
+                    out_traits_t::set(p, out_colors + e, static_cast<out_scalar_t>(extra[e]));
+                else
+                    out_traits_t::set(p, out_colors + e, channel_cast<out_scalar_t>(extra[e] / in_unit * out_unit));
+        }
+        function_t<Y, X> f_;
+        alpha_mode_t     mode_;
+    };
+
+    ///
+    /// @brief Function on pixels with extra channels built from the colour transform f
+    ///
+    template <class YA, class XA, class Y, class X>
+    function_t<YA, XA> with_extra_channels(const function_t<Y, X> &f, alpha_mode_t mode = alpha_mode_t::straight)
+    {
+        return function_t<YA, XA>(new extra_channels_t<YA, XA, Y, X>(f, mode));
+    }
+}
+#endif
@@ -0,0 +1,261 @@
+#ifndef iccpp_fixed_lut_H
+#define iccpp_fixed_lut_H
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <vector>
+#include <limits>
+#include <type_traits>
+#include "iccpp_function.h"
+#include "iccpp_pixel_traits.h"
+#include "iccpp_lut_funct.h"
+
+/**
+    @file
+    @brief Fixed point evaluation of transforms between 8 and 16 bit pixels.
+
+    The transform is sampled into a table of 16 bit vertices (0..65535 maps [0, 1]),
+    interpolation is tetrahedral with 16 bit integer weights and 32 bit accumulators.
+    Compared to a floating point lut_t with the same grid the result differs by at most
+    1 LSB (0.5 for output rounding, the rest from vertex and weight quantization, 
+    bounded by (inputs + 1) / 65536), for both 8 and 16 bit outputs.
+    The bound is relative to that floating point table only: the interpolation error
+    of the grid against the transform itself adds to it.
+*/
+namespace iccpp
+{
+    ///
+    /// @brief True for pixels made of 8 or 16 bit unsigned channels
+    ///
+    template <class P, bool = channel_traits_t<P>::supported>
+    struct fixed_pixel_t
+    {
+        enum { value = false };
+    };
+
+    template <class P>
+    struct fixed_pixel_t<P, true>
+    {
+        typedef typename channel_traits_t<P>::scalar_type scalar_type;
+        enum { value = std::is_integral<scalar_type>::value && std::is_unsigned<scalar_type>::value && sizeof(scalar_type) <= 2 };
+    };
+
+    ///
+    /// @class fixed_lut_t
+    /// @brief Lookup table with tetrahedral interpolation done in fixed point
+    ///
+    template <class Y, class X>
+    class fixed_lut_t : public algo_span_t<fixed_lut_t<Y, X>, Y, X>
+    {
+    public:
+        typedef channel_traits_t<X> input_traits_t;
+        typedef channel_traits_t<Y> output_traits_t;
+        typedef typename input_traits_t::scalar_type input_type;
+        typedef typename output_traits_t::scalar_type output_type;
+        enum { inputs = input_traits_t::channels, outputs = output_traits_t::channels };
+        enum { unit = 65536 }; // weight one
+        // largest input value, a constant so that split divides by multiplication
+        static constexpr unsigned long long input_max = std::numeric_limits<input_type>::max();
+
+        fixed_lut_t(size_t grid) : grid_(grid)
+        {
+            size_t nodes = 1;
+            for (int i = 0; i < inputs; i++)
+            {
+                stride_[i] = nodes;
+                nodes *= grid;
+            }
+            table_.resize(nodes * outputs);
+            // with 8 bit inputs cell and weight are tabulated
+            if (input_max < 256)
+                for (size_t v = 0; v <= input_max; v++)
+                    split(static_cast<axis_value_t>(v), axis_index_[v], axis_weight_[v]);
+            // vertices of the tetrahedron of each code of simplex_order_t<3>, as table offsets
+            if (inputs == 3)
+            {
+                const simplex_order_t<3> &order = simplex_order_t<3>::instance();
+                for (size_t code = 0; code < 8; code++)
+                {
+                    first_[code] = stride_[order.axis[code][0]] * outputs;
+                    second_[code] = first_[code] + stride_[order.axis[code][1]] * outputs;
+                }
+            }
+        }
+        size_t grid(void) const { return grid_; }
+        size_t nodes(void) const { return table_.size() / outputs; }
+        ///
+        /// @brief Sets node i (components in [0, 1]) 
+        ///
+        void set(size_t node, int channel, double value)
+        {
+            value = (value < 0.0 ? 0.0 : (value > 1.0 ? 1.0 : value));
+            table_[node * outputs + channel] = static_cast<unsigned short>(value * 65535 + 0.5);
+        }
+        virtual Y eval(const X &x) const override
+        {
+            struct item_t
+            {
+                unsigned int weight;
+                size_t       offset;
+            } items[inputs];
+            size_t base = 0;
+            for (int a = 0; a < inputs; a++)
+            {
+                size_t index;
+                unsigned int weight;
+                axis_value_t v = input_traits_t::get(x, a);
+                if (input_max < 256)
+                {
+                    index = axis_index_[v];
+                    weight = axis_weight_[v];
+                }
+                else
+                    split(v, index, weight);
+                base += index * stride_[a];
+                // insertion sort, weights in decreasing order
+                int k = a;
+                for (; k > 0 && items[k - 1].weight < weight; k--)
+                    items[k] = items[k - 1];
+                items[k].weight = weight;
+                items[k].offset = stride_[a];
+            }
+            const unsigned short *vertex = &table_[base * outputs];
+            unsigned int acc[outputs];
+            unsigned int w = unit - items[0].weight;
+            for (int c = 0; c < outputs; c++)
+                acc[c] = vertex[c] * w;
+            for (int a = 0; a < inputs; a++)
+            {
+                vertex += items[a].offset * outputs;
+                w = items[a].weight - (a + 1 < inputs ? items[a + 1].weight : 0);
+                for (int c = 0; c < outputs; c++)
+                    acc[c] += vertex[c] * w;
+            }
+            Y result;
+            for (int c = 0; c < outputs; c++)
+                output_traits_t::set(result, c, output(acc[c]));
+            return result;
+        }
+        virtual void eval_n(const X *x, Y *y, size_t n) const override
+        {
+            if (inputs == 3)
+                eval3_n(x, y, n);
+            else
+                algo_span_t<fixed_lut_t<Y, X>, Y, X>::eval_n(x, y, n);
+        }
+        virtual fixed_lut_t<Y, X> *clone(void) const override
+        {
+            return new fixed_lut_t<Y, X>(*this);
+        }
+    private:
+        // the span of 3 inputs: the tetrahedron comes from three comparisons and a table
+        // instead of sorting the weights, the cell of 8 bit inputs from axis_index_
+        void eval3_n(const X *x, Y *y, size_t n) const
+        {
+            const simplex_order_t<3> &order = simplex_order_t<3>::instance();
+            const size_t stride[3] = { stride_[0] * outputs, stride_[1] * outputs, stride_[2] * outputs };
+            const size_t last = stride[0] + stride[1] + stride[2];
+            const unsigned short *table = table_.data();
+            for (size_t i = 0; i < n; i++)
+            {
+                size_t base = 0;
+                unsigned int w[3];
+                for (int a = 0; a < 3; a++)
+                {
+                    axis_value_t v = input_traits_t::get(x[i], a);
+                    size_t index;
+                    if (input_max < 256)
+                    {
+                        index = axis_index_[v];
+                        w[a] = axis_weight_[v];
+                    }
+                    else
+                        split(v, index, w[a]);
+                    base += index * stride[a];
+                }
+                // bits as in simplex_order_t<3>::bit
+                size_t code = (w[0] >= w[1]) | (w[0] >= w[2]) << 1 | (w[1] >= w[2]) << 2;
+                const unsigned char *axis = order.axis[code];
+                unsigned int w1 = w[axis[0]];
+                unsigned int w2 = w[axis[1]];
+                unsigned int w3 = w[axis[2]];
+                const unsigned short *v0 = table + base;
+                const unsigned short *v1 = v0 + first_[code];
+                const unsigned short *v2 = v0 + second_[code];
+                const unsigned short *v3 = v0 + last;
+                for (int c = 0; c < outputs; c++)
+                {
+                    unsigned int acc = v0[c] * (unit - w1) + v1[c] * (w1 - w2) + v2[c] * (w2 - w3) + v3[c] * w3;
+                    output_traits_t::set(y[i], c, output(acc));
+                }
+            }
+        }
+        typedef unsigned int axis_value_t;
+        // cell index and 16 bit weight of an input value: v * (grid - 1) / input_max in 
+        // 16.16 fixed point, the division being a multiplication by 2^48 / input_max
+        // rounded up, so that the nodes are exact and the weights are truncated
+        void split(axis_value_t v, size_t &index, unsigned int &weight) const
+        {
+            static constexpr unsigned long long reciprocal = ((1ULL << 48) + input_max - 1) / input_max;
+            unsigned long long t = (static_cast<unsigned long long>(v) * (grid_ - 1) * reciprocal) >> 32;
+            index = static_cast<size_t>(t >> 16);
+            weight = static_cast<unsigned int>(t & (unit - 1));
+            if (index == grid_ - 1 && index > 0)
+            {
+                index--;
+                weight = unit;
+            }
+        }
+        static output_type output(unsigned int acc)
+        {
+            unsigned int v16 = (acc + unit / 2) >> 16;
+            unsigned int max = std::numeric_limits<output_type>::max();
+            return static_cast<output_type>(max == 65535 ? v16 : (v16 * max + 32767) / 65535);
+        }
+        size_t                      grid_;
+        size_t                      stride_[inputs];
+        std::vector<unsigned short> table_;
+        size_t                      axis_index_[256];
+        unsigned int                axis_weight_[256];
+        size_t                      first_[8];  // offset of the second vertex, by tetrahedron
+        size_t                      second_[8]; // offset of the third vertex, by tetrahedron
+    };
+
+    ///
+    /// @brief Samples f, a function on the floating point equivalents of X and Y,
+    ///        into a fixed point lookup table with the given grid. Nodes are
+    ///        evaluated in parallel blocks (see sample_lut_blocks), each block is
+    ///        quantized as soon as it is ready.
+    ///
+    template <class Y, class X, class RY, class RX>
+    function_t<Y, X> make_fixed_lut(const function_t<RY, RX> &f, size_t grid, 
+                                    worker_pool_t &pool = worker_pool_t::instance())
+    {
+        typedef channel_traits_t<RX> real_input_t;
+        typedef channel_traits_t<RY> real_output_t;
+        std::unique_ptr<fixed_lut_t<Y, X>> lut(new fixed_lut_t<Y, X>(grid));
+        fixed_lut_t<Y, X> &table = *lut;
+        size_t steps[real_input_t::channels];
+        std::fill(steps, steps + real_input_t::channels, grid);
+        sample_lut_blocks(f, steps, [grid](const size_t *digits)
+        {
+            RX x;
+            for (int j = 0; j < real_input_t::channels; j++)
+                real_input_t::set(x, j, static_cast<double>(digits[j]) / (grid - 1));
+            return x;
+        }, [&table](size_t first, const RY *y, size_t count)
+        {
+            for (size_t i = 0; i < count; i++)
+                for (int c = 0; c < real_output_t::channels; c++)
+                    table.set(first + i, c, real_output_t::get(y[i], c));
+        }, pool);
+        return function_t<Y, X>(lut.release());
+    }
+}
+#endif
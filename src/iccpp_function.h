@@ -12,8 +12,14 @@
 #include "iccpp_config.h"
 
 #include <memory>
+#include <vector>
+#include <algorithm>
 namespace iccpp
 {
+    ///
+    /// @brief Number of values pushed through a stage at once by span evaluation
+    ///
+    const size_t span_block_size = 256;
 
     class visitor_base_t
     {
@@ -27,9 +33,48 @@ namespace iccpp
     class algo_base_t
     {
     public:
+        typedef std::vector<std::shared_ptr<algo_base_t>> stage_list_t;
         virtual ~algo_base_t(void) {}
         virtual void accept_domain(visitor_base_t &) = 0;
         virtual void accept_range(visitor_base_t &) {}
+        ///
+        /// @brief Type erased span evaluation, x and y point to arrays of domain and range type
+        ///
+        virtual void eval_span(const void *x, void *y, size_t n) const = 0;
+        virtual size_t range_size(void) const = 0; ///< sizeof the range type
+        ///
+        /// @brief Chain optimization support: appends to stages the sequence of
+        ///        algorithms equivalent to self (in evaluation order)
+        ///
+        virtual void flatten(std::shared_ptr<algo_base_t> self, stage_list_t &stages) const
+        {
+            stages.push_back(self);
+        }
+        ///
+        /// @brief Chain optimization support: returns a new algorithm equivalent to
+        ///        this one applied after prev, nullptr if the two cannot be merged
+        ///
+        virtual algo_base_t *fuse(const algo_base_t &) const { return nullptr; }
+        ///
+        /// @brief Chain optimization support: returns a new algorithm equivalent to
+        ///        this one evaluated from tables, nullptr if there is none
+        ///
+        virtual algo_base_t *bake(void) const { return nullptr; }
+        virtual bool is_identity(void) const { return false; }
+        ///
+        /// @brief Profiling support (see iccpp_instrument.h): returns self, or a copy
+        ///        of the tree below self, wrapped by stage probes. Algorithms override
+        ///        it only when ICCPP_PROFILE_STAGES is defined.
+        ///
+        virtual std::shared_ptr<algo_base_t> instrument(std::shared_ptr<algo_base_t> self, bool) const
+        {
+            return self;
+        }
+        ///
+        /// @brief Profiling support: appends to stages the algorithms this one is
+        ///        made of (in evaluation order), nothing for the leaves
+        ///
+        virtual void children(stage_list_t &) const {}
     };
 
     template <class X>
@@ -65,6 +110,12 @@ namespace iccpp
        onto values of type Y. This class is used as letter in a letter-envelope pattern,
        where the function_t template playes the role of th nvelope
     */
+    template <class Y, class X> class algo_t;
+#ifdef ICCPP_PROFILE_STAGES
+    template <class Y, class X>
+    std::shared_ptr<algo_base_t> make_stage_probe(std::shared_ptr<algo_t<Y, X>>, bool);
+#endif
+
     template <class Y, class X>
     class algo_t : virtual public algo_domain_t<X>,
                    virtual public algo_range_t<Y>
@@ -84,6 +135,27 @@ namespace iccpp
         /// @brief Interface of the evaluation function
         ///
         virtual Y eval(const X &x) const = 0;
+        ///
+        /// @brief Evaluation of a span of n values. Default implementation loops on eval,
+        ///        derived classes should override to pay dispatch cost once per span.
+        ///        Implementations must allow x and y to refer to the same storage.
+        ///
+        virtual void eval_n(const X *x, Y *y, size_t n) const
+        {
+            for (size_t i = 0; i < n; i++)
+                y[i] = eval(x[i]);
+        }
+        virtual void eval_span(const void *x, void *y, size_t n) const override
+        {
+            eval_n(static_cast<const X *>(x), static_cast<Y *>(y), n);
+        }
+        virtual size_t range_size(void) const override { return sizeof(Y); }
+#ifdef ICCPP_PROFILE_STAGES
+        virtual std::shared_ptr<algo_base_t> instrument(std::shared_ptr<algo_base_t> self, bool ranges) const override
+        {
+            return make_stage_probe<Y, X>(std::dynamic_pointer_cast<algo_t<Y, X>>(self), ranges);
+        }
+#endif
         ///
         /// @brief Visitor-related functions allows type inspection
         ///
@@ -101,6 +173,23 @@ namespace iccpp
         }
     };
 
+    ///
+    /// @class algo_span_t
+    /// @brief Base for algorithms whose eval can be inlined in a loop: eval_n
+    ///        calls D::eval without going through the virtual table.
+    ///
+    template <class D, class Y, class X>
+    class algo_span_t : public algo_t<Y, X>
+    {
+    public:
+        virtual void eval_n(const X *x, Y *y, size_t n) const override
+        {
+            const D *self = static_cast<const D *>(this);
+            for (size_t i = 0; i < n; i++)
+                y[i] = self->D::eval(x[i]);
+        }
+    };
+
     ///
     /// @class function_t
     /// @brief This is a envelope class used to represent functions. 
@@ -134,10 +223,42 @@ namespace iccpp
                 X x = rhs_->eval(z);
                 return lhs_->eval(x);
             }
+            ///
+            /// @brief Span evaluation: each stage processes a whole block
+            ///        through a scratch buffer on the stack holding the intermediate values
+            ///
+            virtual void eval_n(const Z *z, Y *y, size_t n) const override
+            {
+                X x[span_block_size];
+                for (size_t i = 0; i < n; i += span_block_size)
+                {
+                    size_t m = std::min(n - i, span_block_size);
+                    rhs_->eval_n(z + i, x, m);
+                    lhs_->eval_n(x, y + i, m);
+                }
+            }
             virtual composite_t<Z> *clone(void) const override
             {
                 return new composite_t<Z>(lhs_, rhs_);
             }
+            virtual void flatten(std::shared_ptr<algo_base_t>, algo_base_t::stage_list_t &stages) const override
+            {
+                rhs_->flatten(rhs_, stages);
+                lhs_->flatten(lhs_, stages);
+            }
+#ifdef ICCPP_PROFILE_STAGES
+            virtual std::shared_ptr<algo_base_t> instrument(std::shared_ptr<algo_base_t>, bool ranges) const override
+            {
+                std::shared_ptr<algo_t<Y, X>> lhs = std::dynamic_pointer_cast<algo_t<Y, X>>(lhs_->instrument(lhs_, ranges));
+                std::shared_ptr<algo_t<X, Z>> rhs = std::dynamic_pointer_cast<algo_t<X, Z>>(rhs_->instrument(rhs_, ranges));
+                return make_stage_probe<Y, Z>(std::make_shared<composite_t<Z>>(lhs, rhs), ranges);
+            }
+#endif
+            virtual void children(algo_base_t::stage_list_t &stages) const override
+            {
+                stages.push_back(rhs_);
+                stages.push_back(lhs_);
+            }
         private:
             std::shared_ptr<algo_t<Y, X>> lhs_;
             std::shared_ptr<algo_t<X, Z>> rhs_;
@@ -163,6 +284,10 @@ namespace iccpp
         {
             return eval(x);
         }
+        void eval_n(const domain_type *x, range_type *y, size_t n) const ///< Span evaluation
+        {
+            imp_->eval_n(x, y, n);
+        }
         algo_t<Y, X> *clone(void) const
         { 
             return imp_->clone(); 
@@ -192,8 +317,17 @@ namespace iccpp
         {
             return new identity_t();
         }
+        virtual void eval_n(const X *x, X *y, size_t n) const override
+        {
+            if (x != y)
+                std::copy(x, x + n, y);
+        }
+        virtual bool is_identity(void) const override { return true; }
     };
 
 
 }
+#ifdef ICCPP_PROFILE_STAGES
+#include "iccpp_instrument.h"
+#endif
 #endif
@@ -11,6 +11,7 @@
 //
 #include <cstring>
 #include "iccpp_function.h"
+#include "iccpp_parallel.h"
 
 namespace iccpp
 {
@@ -65,16 +66,38 @@ namespace iccpp
             {
                 pixel_type *dest = this->operator[](i);
                 const typename image_t<P1>::pixel_type *src = img[i];
-                for (int j = 0; j < size_.x; j++)
-                    dest[j] = f(src[j]);                    
+                f.eval_n(src, dest, size_.x);
             }
         }
+        ///
+        /// @brief Parallel version of apply: the image is split in bands of rows
+        ///        processed by the threads of pool (the function is shared)
+        ///
+        template <class P1>
+        void apply(const function_t<P, P1> &f, const image_t<P1> &img, worker_pool_t &pool)
+        {
+            size_t rows = static_cast<size_t>(size_.y);
+            size_t bands = std::min(rows, pool.size() * bands_per_thread);
+            pool.run(bands, [&](size_t band)
+            {
+                int first = static_cast<int>(band * rows / bands);
+                int last = static_cast<int>((band + 1) * rows / bands);
+                for (int i = first; i < last; i++)
+                    f.eval_n(img[i], this->operator[](i), size_.x);
+            });
+        }
         template <class F>
         void apply(const F &f)
         {
             apply(f, *this);
         }
+        template <class F>
+        void apply(const F &f, worker_pool_t &pool)
+        {
+            apply(f, *this, pool);
+        }
     private:
+        enum { bands_per_thread = 4 }; // more bands than threads balances uneven rows
         pixel_type *data_;
         point_t     size_;
         int         line_size_;
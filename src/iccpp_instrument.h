@@ -0,0 +1,273 @@
+#ifndef iccpp_instrument_H
+#define iccpp_instrument_H
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+#include <type_traits>
+#include <vector>
+#include <limits>
+#ifdef __GNUG__
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
+#include "iccpp_function.h"
+
+/**
+    @file
+    @brief Per stage profiling of transforms.
+
+    instrument(f) returns a copy of f where every algorithm of the tree is wrapped
+    by a stage_probe_t counting calls, evaluated values and nanoseconds spent
+    (inclusive of the stages below), optionally with the range of the values seen
+    on both sides. dump_stages prints the tree with those numbers.
+    Probes exist only when ICCPP_PROFILE_STAGES is defined, for the whole program:
+    the overrides of algo_base_t::instrument that create them are compiled out
+    otherwise, so instrument(f) returns f itself and dump_stages prints the bare tree.
+    Call sites should use ICCPP_INSTRUMENT(f), that expands to f unless
+    ICCPP_PROFILE_STAGES is defined, so profiling costs nothing when compiled out.
+*/
+#ifdef ICCPP_PROFILE_STAGES
+#define ICCPP_INSTRUMENT(f) ::iccpp::instrument(f, true)
+#else
+#define ICCPP_INSTRUMENT(f) (f)
+#endif
+
+namespace iccpp
+{
+    ///
+    /// @brief Channel access used to track value ranges: pixels laid out as an
+    ///        array of dimension values of scalar_type, plus plain doubles
+    ///
+    template <class P, class = void>
+    struct probe_channels_t
+    {
+        enum { channels = 0 };
+        static double get(const P &, int) { return 0.0; }
+    };
+
+    template <class P>
+    struct probe_channels_t<P, typename std::enable_if<sizeof(P) == P::dimension * sizeof(typename P::scalar_type)>::type>
+    {
+        enum { channels = P::dimension };
+        static double get(const P &p, int c) { return static_cast<double>(reinterpret_cast<const typename P::scalar_type *>(&p)[c]); }
+    };
+
+    template <>
+    struct probe_channels_t<double>
+    {
+        enum { channels = 1 };
+        static double get(const double &p, int) { return p; }
+    };
+
+    inline std::string stage_type_name(const algo_base_t &algo)
+    {
+        const char *name = typeid(algo).name();
+#ifdef __GNUG__
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+        if (demangled != nullptr)
+        {
+            std::string result(demangled);
+            std::free(demangled);
+            return result;
+        }
+#endif
+        return name;
+    }
+
+    ///
+    /// @brief Numbers collected by a stage_probe_t
+    ///
+    struct stage_report_t
+    {
+        std::string         type;        ///< type name of the wrapped algorithm
+        size_t              calls;       ///< eval and eval_n calls
+        size_t              values;      ///< values evaluated
+        double              nanoseconds; ///< time spent, stages below included
+        std::vector<double> input_min;   ///< per channel, empty if ranges are not tracked
+        std::vector<double> input_max;
+        std::vector<double> output_min;
+        std::vector<double> output_max;
+    };
+
+    class stage_probe_base_t
+    {
+    public:
+        virtual ~stage_probe_base_t(void) {}
+        virtual stage_report_t report(void) const = 0;
+        virtual std::shared_ptr<algo_base_t> inner(void) const = 0;
+    };
+
+    ///
+    /// @class stage_probe_t
+    /// @brief Wrapper of an algorithm collecting its execution statistics
+    ///
+    template <class Y, class X>
+    class stage_probe_t : public algo_t<Y, X>, public stage_probe_base_t
+    {
+    public:
+        stage_probe_t(std::shared_ptr<algo_t<Y, X>> algo, bool ranges) : 
+            algo_(algo), ranges_(ranges), calls_(0), values_(0), nanoseconds_(0)
+        {
+            reset_range(input_min_, input_max_, probe_channels_t<X>::channels);
+            reset_range(output_min_, output_max_, probe_channels_t<Y>::channels);
+        }
+        virtual Y eval(const X &x) const override
+        {
+            Y y;
+            eval_n(&x, &y, 1);
+            return y;
+        }
+        virtual void eval_n(const X *x, Y *y, size_t n) const override
+        {
+            if (ranges_)
+                track<X>(x, n, input_min_, input_max_);
+            clock_t::time_point start = clock_t::now();
+            algo_->eval_n(x, y, n);
+            nanoseconds_ += std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - start).count();
+            calls_++;
+            values_ += n;
+            if (ranges_)
+                track<Y>(y, n, output_min_, output_max_);
+        }
+        virtual stage_probe_t<Y, X> *clone(void) const override
+        {
+            return new stage_probe_t<Y, X>(std::shared_ptr<algo_t<Y, X>>(algo_->clone()), ranges_);
+        }
+        virtual void children(algo_base_t::stage_list_t &stages) const override
+        {
+            stages.push_back(algo_);
+        }
+        virtual stage_report_t report(void) const override
+        {
+            stage_report_t result;
+            result.type = stage_type_name(*algo_);
+            result.calls = calls_;
+            result.values = values_;
+            result.nanoseconds = static_cast<double>(nanoseconds_);
+            if (ranges_ && values_ > 0)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                result.input_min = input_min_;
+                result.input_max = input_max_;
+                result.output_min = output_min_;
+                result.output_max = output_max_;
+            }
+            return result;
+        }
+        virtual std::shared_ptr<algo_base_t> inner(void) const override
+        {
+            return algo_;
+        }
+    private:
+        typedef std::chrono::steady_clock clock_t;
+        static void reset_range(std::vector<double> &lower, std::vector<double> &upper, size_t channels)
+        {
+            lower.assign(channels, std::numeric_limits<double>::max());
+            upper.assign(channels, -std::numeric_limits<double>::max());
+        }
+        template <class P>
+        void track(const P *p, size_t n, std::vector<double> &lower, std::vector<double> &upper) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = 0; i < n; i++)
+                for (int c = 0; c < probe_channels_t<P>::channels; c++)
+                {
+                    double value = probe_channels_t<P>::get(p[i], c);
+                    lower[c] = std::min(lower[c], value);
+                    upper[c] = std::max(upper[c], value);
+                }
+        }
+        std::shared_ptr<algo_t<Y, X>>       algo_;
+        bool                                ranges_;
+        mutable std::atomic<size_t>         calls_;
+        mutable std::atomic<size_t>         values_;
+        mutable std::atomic<long long>      nanoseconds_;
+        mutable std::mutex                  mutex_;
+        mutable std::vector<double>         input_min_;
+        mutable std::vector<double>         input_max_;
+        mutable std::vector<double>         output_min_;
+        mutable std::vector<double>         output_max_;
+    };
+
+    template <class Y, class X>
+    std::shared_ptr<algo_base_t> make_stage_probe(std::shared_ptr<algo_t<Y, X>> algo, bool ranges)
+    {
+        return std::make_shared<stage_probe_t<Y, X>>(algo, ranges);
+    }
+
+    ///
+    /// @brief Copy of f with every algorithm of the tree wrapped by a stage_probe_t
+    ///
+    template <class Y, class X>
+    function_t<Y, X> instrument(const function_t<Y, X> &f, bool ranges = false)
+    {
+        std::shared_ptr<algo_base_t> algo = f.imp();
+        return function_t<Y, X>(std::dynamic_pointer_cast<algo_t<Y, X>>(algo->instrument(algo, ranges)));
+    }
+
+    ///
+    /// @brief Prints one line per algorithm of the tree, children indented below
+    ///        their parent in evaluation order, with the numbers of the probes
+    ///
+    class stage_dumper_t
+    {
+    public:
+        explicit stage_dumper_t(std::ostream &ost) : ost_(ost) {}
+        void visit(const algo_base_t &algo, int depth = 0)
+        {
+            const stage_probe_base_t *probe = dynamic_cast<const stage_probe_base_t *>(&algo);
+            std::shared_ptr<algo_base_t> inner;
+            ost_ << std::string(2 * depth, ' ');
+            if (probe != nullptr)
+            {
+                stage_report_t report = probe->report();
+                ost_ << report.type << ": " << report.calls << " calls, " << report.values << " values, "
+                     << report.nanoseconds << " ns";
+                if (report.values > 0)
+                    ost_ << " (" << report.nanoseconds / report.values << " ns/value)";
+                print_range(" in", report.input_min, report.input_max);
+                print_range(" out", report.output_min, report.output_max);
+                inner = probe->inner();
+            }
+            else
+                ost_ << stage_type_name(algo);
+            ost_ << "\n";
+            algo_base_t::stage_list_t stages;
+            (inner ? *inner : algo).children(stages);
+            for (const std::shared_ptr<algo_base_t> &stage : stages)
+                visit(*stage, depth + 1);
+        }
+    private:
+        void print_range(const char *label, const std::vector<double> &lower, const std::vector<double> &upper)
+        {
+            if (lower.empty())
+                return;
+            ost_ << label << " [";
+            for (size_t c = 0; c < lower.size(); c++)
+                ost_ << (c == 0 ? "" : ", ") << lower[c] << ".." << upper[c];
+            ost_ << "]";
+        }
+        std::ostream &ost_;
+    };
+
+    template <class Y, class X>
+    void dump_stages(std::ostream &ost, const function_t<Y, X> &f)
+    {
+        if (f.imp())
+            stage_dumper_t(ost).visit(*f.imp());
+    }
+}
+#endif
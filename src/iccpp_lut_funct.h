@@ -9,31 +9,83 @@
 // (See accompanying file LICENSE_1_0.txt or copy at 
 // http://www.boost.org/LICENSE_1_0.txt)
 //
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 #include "iccpp_function.h"
 #include "iccpp_clut.h"
+#include "iccpp_pixel_traits.h"
+#include "iccpp_rgb_traits.h"
+#include "iccpp_optimizer.h"
+#include "iccpp_parallel.h"
 
 namespace iccpp
 {
+    // nodes are sampled in blocks of consecutive table entries
+    const size_t lut_sample_block = span_block_size;
+
     /**
-     *  @brief Turn a given function into an equivalent one based on a lookup table
+     *  @brief Evaluates f at the nodes of a grid of steps[k] nodes along axis k, 
+     *         the first axis running fastest; node(digits) is the input of a node.
+     *         Blocks of nodes are spread over the threads of pool and evaluated
+     *         through eval_n, then handed to store(first, y, count) with the index of
+     *         their first node. Digits are stepped as an odometer, only the first
+     *         node of a block is found by division.
      */
-    template <class Y, class X, class I = interp_tetra_t>
-    function_t<Y, X> make_lut(const function_t<Y, X> &f, const size_t *steps, const X &step)
+    template <class Y, class X, class N, class S>
+    void sample_lut_blocks(const function_t<Y, X> &f, const size_t *steps, N node, S store, worker_pool_t &pool)
     {
-        using scalar_type = typename X::scalar_type;
-        std::unique_ptr< lut_t<Y, X, I> > lut(new lut_t<Y, X, I>(steps, step));
-        size_t size = lut->datasize();
-        for (size_t i = 0; i < size; i++)
+        const size_t dimension = X::dimension;
+        size_t size = 1;
+        for (size_t k = 0; k < dimension; k++)
+            size *= steps[k];
+        size_t blocks = (size + lut_sample_block - 1) / lut_sample_block;
+        pool.run(blocks, [&](size_t block)
         {
-            size_t components[X::dimension];
-            for (size_t j = 0, t = i; j < X::dimension; j++)
+            size_t first = block * lut_sample_block;
+            size_t count = std::min(lut_sample_block, size - first);
+            size_t digits[dimension];
+            for (size_t k = 0, t = first; k < dimension; k++)
             {
-                components[j] = t % steps[j];
-                t /= steps[j];
+                digits[k] = t % steps[k];
+                t /= steps[k];
             }
-            X x = lut_input_traits_t<X>::build(step, components);
-            (*lut)[i] = f(x);
-        }
+            X x[lut_sample_block];
+            Y y[lut_sample_block];
+            for (size_t i = 0; i < count; i++)
+            {
+                x[i] = node(static_cast<const size_t *>(digits));
+                for (size_t k = 0; k < dimension && ++digits[k] == steps[k]; k++)
+                    digits[k] = 0;
+            }
+            f.eval_n(x, y, count);
+            store(first, static_cast<const Y *>(y), count);
+        });
+    }
+
+    /**
+     *  @brief Fills table with f at the nodes of the grid, see sample_lut_blocks
+     */
+    template <class Y, class X, class N>
+    void sample_lut(const function_t<Y, X> &f, Y *table, const size_t *steps, N node, worker_pool_t &pool)
+    {
+        sample_lut_blocks(f, steps, node, [table](size_t first, const Y *y, size_t count)
+        {
+            std::copy(y, y + count, table + first);
+        }, pool);
+    }
+
+    /**
+     *  @brief Turn a given function into an equivalent one based on a lookup table
+     */
+    template <class Y, class X, class I = interp_tetra_t>
+    function_t<Y, X> make_lut(const function_t<Y, X> &f, const size_t *steps, const X &step,
+                              worker_pool_t &pool = worker_pool_t::instance())
+    {
+        std::unique_ptr< lut_t<Y, X, I> > lut(new lut_t<Y, X, I>(steps, step));
+        sample_lut(f, &(*lut)[0], steps, 
+                   [&step](const size_t *digits) { return lut_input_traits_t<X>::build(step, digits); }, pool);
         return function_t<Y, X>(lut.release());
     }
 
@@ -41,12 +93,401 @@ namespace iccpp
     function_t<Y, X> make_lut(const function_t<Y, X> &f, size_t steps)
     {
         using scalar_type = typename X::scalar_type;
-        X dx(static_cast<scalar_type>(scalar_traits_t<scalar_type>::one() / (steps - 1)));
+        X dx(lut_input_traits_t<X>::uniform(static_cast<scalar_type>(scalar_traits_t<scalar_type>::one() / (steps - 1))));
         size_t gridsteps[X::dimension];
 
         for (size_t i = 0; i < X::dimension; i++)
             gridsteps[i] = steps;
-        return make_lut<X, Y, I>(f, gridsteps, dx);
+        return make_lut<Y, X, I>(f, gridsteps, dx);
+    }
+
+    /**
+     *  @brief Lookup table with the nodes on the given axes, one for each input
+     */
+    template <class Y, class X, class I = interp_tetra_t>
+    function_t<Y, X> make_lut(const function_t<Y, X> &f, const std::vector<grid_axis_t> &axes,
+                              worker_pool_t &pool = worker_pool_t::instance())
+    {
+        std::unique_ptr< nonuniform_lut_t<Y, X, I> > lut(new nonuniform_lut_t<Y, X, I>(axes));
+        const nonuniform_lut_t<Y, X, I> &table = *lut;
+        sample_lut(f, &(*lut)[0], table.table().size(), [&table](const size_t *digits)
+        {
+            X x;
+            for (size_t k = 0; k < X::dimension; k++)
+                x[k] = static_cast<typename X::scalar_type>(table.axis(k)[digits[k]]);
+            return x;
+        }, pool);
+        return function_t<Y, X>(lut.release());
+    }
+
+    // samples of [0, 1] used to integrate densities and to estimate curvature
+    const size_t grid_density_samples = 256;
+
+    /**
+     *  @brief Axis of the given number of nodes spaced so that each cell holds the
+     *         same integral of density, a positive function on [0, 1].
+     *         Throws std::invalid_argument with less than 2 nodes.
+     */
+    template <class F>
+    grid_axis_t density_grid_axis(F density, size_t nodes)
+    {
+        if (nodes < 2)
+            throw std::invalid_argument("density_grid_axis needs at least 2 nodes");
+        const size_t samples = grid_density_samples;
+        std::vector<double> cumulative(samples + 1, 0.0);
+        double previous = density(0.0);
+        for (size_t i = 1; i <= samples; i++)
+        {
+            double current = density(static_cast<double>(i) / samples);
+            cumulative[i] = cumulative[i - 1] + 0.5 * (previous + current) / samples;
+            previous = current;
+        }
+        std::vector<double> breakpoints(nodes);
+        size_t i = 0;
+        for (size_t n = 1; n + 1 < nodes; n++)
+        {
+            double target = cumulative[samples] * n / (nodes - 1);
+            while (cumulative[i + 1] < target)
+                i++;
+            double t = (target - cumulative[i]) / (cumulative[i + 1] - cumulative[i]);
+            breakpoints[n] = (i + t) / samples;
+        }
+        breakpoints[0] = 0.0;
+        breakpoints[nodes - 1] = 1.0;
+        return grid_axis_t(breakpoints);
+    }
+
+    /**
+     *  @brief Axes of the given number of nodes following the curvature of f.
+     *         Linear interpolation errs by about |f''| h^2 / 8 in a cell of width h, 
+     *         so a node density growing as sqrt|f''| spreads the error evenly.
+     *         Curvature along an axis is averaged over a few lines crossing the domain,
+     *         a uniform share of the density keeps nodes in the flat parts too.
+     */
+    template <class Y, class X>
+    std::vector<grid_axis_t> curvature_grid_axes(const function_t<Y, X> &f, size_t nodes)
+    {
+        using scalar_type = typename X::scalar_type;
+        const size_t samples = grid_density_samples;
+        const size_t lines = 16;
+        std::vector<grid_axis_t> result;
+        for (size_t k = 0; k < X::dimension; k++)
+        {
+            std::vector<double> curvature(samples + 1, 0.0);
+            for (size_t line = 0; line < lines; line++)
+            {
+                X x;
+                for (size_t j = 0; j < X::dimension; j++) // spread lines over the other axes
+                    x[j] = static_cast<scalar_type>(std::fmod((line + 0.5) * (j + 1) * 0.618034, 1.0));
+                std::vector<Y> y(samples + 1);
+                for (size_t i = 0; i <= samples; i++)
+                {
+                    x[k] = static_cast<scalar_type>(static_cast<double>(i) / samples);
+                    y[i] = f(x);
+                }
+                for (size_t i = 1; i < samples; i++)
+                    curvature[i] += std::sqrt(((y[i + 1] - y[i]) - (y[i] - y[i - 1])).module2()) * samples * samples;
+            }
+            curvature[0] = curvature[1];
+            curvature[samples] = curvature[samples - 1];
+            double mean = 0.0;
+            for (double &c : curvature)
+            {
+                c = std::sqrt(c / lines);
+                mean += c / (samples + 1);
+            }
+            result.push_back(density_grid_axis([&curvature, mean](double t)
+            {
+                size_t i = static_cast<size_t>(t * grid_density_samples + 0.5);
+                return curvature[i] + 0.25 * mean + 1e-12;
+            }, nodes));
+        }
+        return result;
+    }
+
+    // interpolation error is about lut_curvature * step^2 for a typical profile chain
+    const double lut_curvature = 0.125;
+    // upper limit to the number of nodes of a precomputed lookup table
+    const double lut_max_nodes = 1 << 21;
+
+    /**
+     *  @brief Number of grid points per dimension of a lookup table expected to approximate
+     *         a function of X within the given error (output range normalized to [0, 1]),
+     *         from lut_curvature: a first guess, make_lut_within measures the actual error.
+     *         For integer scalar types (grid - 1) must divide one()
+     */
+    template <class X>
+    size_t lut_grid_size(double error)
+    {
+        using scalar_type = typename X::scalar_type;
+        size_t grid = static_cast<size_t>(std::ceil(std::sqrt(lut_curvature / error))) + 1;
+        while (grid > 2 && std::pow(static_cast<double>(grid), X::dimension) > lut_max_nodes)
+            grid--;
+        if (std::is_integral<scalar_type>::value)
+        {
+            size_t one = static_cast<size_t>(scalar_traits_t<scalar_type>::one());
+            size_t upper = grid;
+            while (upper <= one + 1 && one % (upper - 1) != 0)
+                upper++;
+            if (upper <= one + 1 && std::pow(static_cast<double>(upper), X::dimension) <= lut_max_nodes)
+                return upper;
+            while (grid > 2 && one % (grid - 1) != 0)
+                grid--;
+        }
+        return grid;
+    }
+
+    // off grid points on which the error of a lookup table is measured
+    const size_t lut_error_samples = 4096;
+    // the first of those points, on which make_lut_within screens a grid before building it
+    const size_t lut_estimate_samples = 512;
+
+    /**
+     *  @brief The first count points of lut_error.
+     *         Coordinates follow an additive recurrence on the fractional part of the 
+     *         square root of a prime per axis, so points fall off the nodes of the grid;
+     *         for integer scalar types they are the nearest valid value.
+     */
+    template <class X>
+    std::vector<X> lut_error_points(size_t count)
+    {
+        typedef channel_traits_t<X> input_t;
+        typedef typename input_t::scalar_type input_type;
+        static const double primes[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47 };
+        const double input_one = scalar_traits_t<input_type>::one();
+        std::vector<X> x(count);
+        for (size_t i = 0; i < x.size(); i++)
+            for (int k = 0; k < input_t::channels; k++)
+            {
+                double alpha = std::sqrt(primes[k]);
+                double t = (i + 0.5) * (alpha - std::floor(alpha));
+                t -= std::floor(t);
+                input_t::set(x[i], k, static_cast<input_type>(std::is_integral<input_type>::value ? 
+                                                              std::floor(t * input_one + 0.5) : t * input_one));
+            }
+        return x;
+    }
+
+    // largest distance between y0 and y1, see lut_error
+    template <class Y>
+    double lut_max_distance(const std::vector<Y> &y0, const std::vector<Y> &y1)
+    {
+        typedef channel_traits_t<Y> output_t;
+        const double output_one = scalar_traits_t<typename output_t::scalar_type>::one();
+        double result = 0.0;
+        for (size_t i = 0; i < y0.size(); i++)
+        {
+            double distance = 0.0;
+            for (int c = 0; c < output_t::channels; c++)
+                distance += std::fabs(static_cast<double>(output_t::get(y0[i], c)) - output_t::get(y1[i], c));
+            result = std::max(result, distance / output_one);
+        }
+        return result;
+    }
+
+    /**
+     *  @brief Largest distance between f and g over the lut_error_samples points of 
+     *         lut_error_points: the sum of the absolute differences of the channels, 
+     *         normalized to [0, 1].
+     */
+    template <class Y, class X>
+    double lut_error(const function_t<Y, X> &f, const function_t<Y, X> &g)
+    {
+        std::vector<X> x = lut_error_points<X>(lut_error_samples);
+        std::vector<Y> y0(x.size()), y1(x.size());
+        f.eval_n(x.data(), y0.data(), x.size());
+        g.eval_n(x.data(), y1.data(), x.size());
+        return lut_max_distance(y0, y1);
+    }
+
+    /**
+     *  @brief lut_error of the lookup table of steps nodes per axis sampling f, over the
+     *         first count points of lut_error_points, without building the table: each
+     *         point is interpolated from f at the corners of its cell, as the table does.
+     *         Costs count * (2^dimension + 1) evaluations of f.
+     */
+    template <class Y, class X, class I = interp_tetra_t>
+    double lut_error_at(const function_t<Y, X> &f, size_t steps, size_t count)
+    {
+        typedef channel_traits_t<X> input_t;
+        typedef typename input_t::scalar_type input_type;
+        const size_t dimension = X::dimension;
+        const size_t corners = size_t(1) << dimension;
+        X step(lut_input_traits_t<X>::uniform(static_cast<input_type>(scalar_traits_t<input_type>::one() / (steps - 1))));
+        std::vector<X> x = lut_error_points<X>(count);
+        // the points moved to the first cell, and the corners of their cells
+        std::vector<X> local(x.size());
+        std::vector<X> nodes(x.size() * corners);
+        for (size_t i = 0; i < x.size(); i++)
+        {
+            size_t cell[dimension];
+            for (size_t k = 0; k < dimension; k++)
+            {
+                double t = static_cast<double>(input_t::get(x[i], static_cast<int>(k)));
+                cell[k] = std::min(static_cast<size_t>(t / input_t::get(step, static_cast<int>(k))), steps - 2);
+            }
+            X corner = lut_input_traits_t<X>::build(step, cell);
+            for (size_t k = 0; k < dimension; k++)
+                input_t::set(local[i], static_cast<int>(k), 
+                             static_cast<input_type>(input_t::get(x[i], static_cast<int>(k)) - 
+                                                     input_t::get(corner, static_cast<int>(k))));
+            for (size_t c = 0; c < corners; c++)
+            {
+                size_t digits[dimension];
+                for (size_t k = 0; k < dimension; k++)
+                    digits[k] = cell[k] + ((c >> k) & 1);
+                nodes[i * corners + c] = lut_input_traits_t<X>::build(step, digits);
+            }
+        }
+        std::vector<Y> y0(x.size()), y1(x.size()), values(nodes.size());
+        f.eval_n(x.data(), y0.data(), x.size());
+        f.eval_n(nodes.data(), values.data(), nodes.size());
+        // a table of one cell, the first axis running fastest as in lut_t
+        size_t size[dimension];
+        std::fill(size, size + dimension, size_t(2));
+        lut_t<Y, X, I> cell(size, step);
+        for (size_t i = 0; i < x.size(); i++)
+        {
+            for (size_t c = 0; c < corners; c++)
+                cell[static_cast<int>(c)] = values[i * corners + c];
+            y1[i] = cell.eval(local[i]);
+        }
+        return lut_max_distance(y0, y1);
+    }
+
+    /**
+     *  @brief Room for the rounding of integer outputs on top of an error budget: 
+     *         one unit per channel, zero for floating point outputs.
+     */
+    template <class Y>
+    double lut_rounding(void)
+    {
+        typedef channel_traits_t<Y> output_t;
+        typedef typename output_t::scalar_type output_type;
+        return std::is_integral<output_type>::value ? static_cast<double>(output_t::channels) / scalar_traits_t<output_type>::one() : 0.0;
+    }
+
+    /**
+     *  @brief Grows a grid from lut_grid_size(error) until measure(steps) is within budget.
+     *         Returns the grid, 0 when lut_max_nodes is reached first;
+     *         grid, when given, receives the last grid tried.
+     */
+    template <class X, class M>
+    size_t grow_lut_grid(double error, double budget, M measure, size_t *grid)
+    {
+        double guess = error;
+        size_t steps = lut_grid_size<X>(guess);
+        for (;;)
+        {
+            if (grid != nullptr)
+                *grid = steps;
+            double measured = measure(steps);
+            if (measured <= budget)
+                return steps;
+            // the error falls as the square of the step, but slower near singularities;
+            // the grids of integer types are sparse, a larger step may be needed to move
+            guess *= std::min(0.5, budget / measured);
+            size_t next = lut_grid_size<X>(guess);
+            for (int i = 0; i < 16 && next <= steps; i++)
+            {
+                guess *= 0.5;
+                next = lut_grid_size<X>(guess);
+            }
+            if (next <= steps)
+                return 0;
+            steps = next;
+        }
+    }
+
+    /**
+     *  @brief Grid of the lookup table approximating f within error, the one make_lut_within
+     *         would build: lut_error_at on all the lut_error_samples points gives the same 
+     *         measure as lut_error on the table, but no table is built. 
+     *         0 when lut_max_nodes is reached first; grid, when given, receives the last grid tried.
+     */
+    template <class Y, class X, class I = interp_tetra_t>
+    size_t lut_grid_within(const function_t<Y, X> &f, double error, size_t *grid = nullptr)
+    {
+        double budget = error + lut_rounding<Y>();
+        return grow_lut_grid<X>(error, budget, [&](size_t steps)
+        {
+            double estimated = lut_error_at<Y, X, I>(f, steps, lut_estimate_samples);
+            if (estimated > budget)
+                return estimated;
+            return lut_error_at<Y, X, I>(f, steps, lut_error_samples);
+        }, grid);
+    }
+
+    /**
+     *  @brief Lookup table approximating f within error, as measured by lut_error, 
+     *         on top of the rounding of integer outputs (lut_rounding).
+     *         The grid starts from lut_grid_size and grows while the error is above
+     *         budget; a grid is built only once lut_error_at on the first 
+     *         lut_estimate_samples points is within budget. An empty function is returned 
+     *         when lut_max_nodes is reached first; grid, when given, receives the last grid tried.
+     */
+    template <class Y, class X, class I = interp_tetra_t>
+    function_t<Y, X> make_lut_within(const function_t<Y, X> &f, double error, size_t *grid = nullptr)
+    {
+        double budget = error + lut_rounding<Y>();
+        function_t<Y, X> lut(static_cast<algo_t<Y, X> *>(nullptr));
+        size_t steps = grow_lut_grid<X>(error, budget, [&](size_t steps)
+        {
+            double estimated = lut_error_at<Y, X, I>(f, steps, lut_estimate_samples);
+            if (estimated > budget)
+                return estimated;
+            lut = make_lut<Y, X, I>(f, steps);
+            return lut_error(f, lut);
+        }, grid);
+        return steps != 0 ? lut : function_t<Y, X>(static_cast<algo_t<Y, X> *>(nullptr));
+    }
+
+    ///
+    /// @brief Options used when building a transform
+    ///
+    struct transform_options_t
+    {
+        transform_options_t(bool opt = false, bool pre = false, double error = 1e-3, bool fixed = false) :
+            optimize(opt), precompute(pre), max_error(error), fixed_point(fixed) {}
+        bool   optimize;    ///< flatten the transform and merge adjacent stages
+        bool   precompute;  ///< sample the whole transform into a single lookup table, 
+                            ///< skipped when max_error is not met within lut_max_nodes
+        double max_error;   ///< error budget of the lookup table, see lut_error
+        bool   fixed_point; ///< for 8/16 bit pixels, sample into a fixed point lookup table
+    };
+
+    // precomputation is possible only on types having lookup table traits,
+    // otherwise the function is left as is
+    template <class Y, class X, bool>
+    struct lut_compiler_t
+    {
+        static function_t<Y, X> exec(const function_t<Y, X> &f, double)
+        {
+            return f;
+        }
+    };
+
+    template <class Y, class X>
+    struct lut_compiler_t<Y, X, true>
+    {
+        static function_t<Y, X> exec(const function_t<Y, X> &f, double error)
+        {
+            function_t<Y, X> lut = make_lut_within<Y, X, interp_tetra_t>(f, error);
+            return lut ? lut : f;
+        }
+    };
+
+    /**
+     *  @brief Applies the transform_options_t to a function
+     */
+    template <class Y, class X>
+    function_t<Y, X> apply_options(const function_t<Y, X> &f, const transform_options_t &options)
+    {
+        function_t<Y, X> result = (options.optimize || options.precompute ? optimize(f) : f);
+        if (options.precompute)
+            return lut_compiler_t<Y, X, lut_input_traits_t<X>::supported &&
+                                        lut_input_traits_t<Y>::supported>::exec(result, options.max_error);
+        return result;
     }
 } // namespace iccpp
 
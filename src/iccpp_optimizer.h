@@ -0,0 +1,148 @@
+#ifndef iccpp_optimizer_H
+#define iccpp_optimizer_H
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "iccpp_function.h"
+
+/**
+    @file
+    @brief Optimization of transforms built as trees of composite_t.
+
+    The tree is flattened into a list of stages, then adjacent stages are merged
+    using the fuse() rules of each algorithm:
+    - identities are dropped
+    - a data interpretation conversion next to its inverse is dropped (exact for
+      rgb and xyz, up to rounding for the Lab encoding)
+    - adjacent matrices are multiplied into a single affine matrix (rounding only)
+    - curve after curve is resampled on fused_curve_knots knots when the error at
+      the middle of the intervals stays within fused_curve_tolerance; steep curves
+      such as gamma 1/2.2 near 0 are left as two stages
+    Then the stages that support it are baked into tables (see bake()): channel
+    curves become icc_curve_baked_t when the table stays within baked_curve_tolerance.
+*/
+namespace iccpp
+{
+    ///
+    /// @class chain_t
+    /// @brief Flat sequence of stages evaluated one after the other. 
+    ///        Intermediate values are kept in type erased buffers, so the 
+    ///        intermediate types must be trivially copyable
+    ///
+    template <class Y, class X>
+    class chain_t : public algo_t<Y, X>
+    {
+    public:
+        chain_t(const algo_base_t::stage_list_t &stages) : stages_(stages), max_size_(0)
+        {
+            for (const std::shared_ptr<algo_base_t> &stage : stages_)
+                max_size_ = std::max(max_size_, stage->range_size());
+        }
+        size_t stages(void) const { return stages_.size(); }
+        virtual Y eval(const X &x) const override
+        {
+            Y y;
+            if (max_size_ <= sizeof(double) * small_words)
+            {
+                double buffer[2][small_words];
+                run(&x, &y, 1, buffer[0], buffer[1]);
+            }
+            else
+                eval_n(&x, &y, 1);
+            return y;
+        }
+        // intermediate values go through two buffers on the stack, blocks are shorter
+        // than span_block_size when they are wider than block_words / span_block_size
+        virtual void eval_n(const X *x, Y *y, size_t n) const override
+        {
+            double buffer[2][block_words];
+            size_t block = std::min(span_block_size, sizeof(buffer[0]) / std::max<size_t>(max_size_, 1));
+            for (size_t i = 0; i < n; i += block)
+                run(x + i, y + i, std::min(n - i, block), buffer[0], buffer[1]);
+        }
+        virtual chain_t<Y, X> *clone(void) const override
+        {
+            return new chain_t<Y, X>(stages_);
+        }
+        virtual void flatten(std::shared_ptr<algo_base_t>, algo_base_t::stage_list_t &stages) const override
+        {
+            stages.insert(stages.end(), stages_.begin(), stages_.end());
+        }
+#ifdef ICCPP_PROFILE_STAGES
+        virtual std::shared_ptr<algo_base_t> instrument(std::shared_ptr<algo_base_t>, bool ranges) const override
+        {
+            algo_base_t::stage_list_t stages;
+            for (const std::shared_ptr<algo_base_t> &stage : stages_)
+                stages.push_back(stage->instrument(stage, ranges));
+            return make_stage_probe<Y, X>(std::make_shared<chain_t<Y, X>>(stages), ranges);
+        }
+#endif
+        virtual void children(algo_base_t::stage_list_t &stages) const override
+        {
+            stages.insert(stages.end(), stages_.begin(), stages_.end());
+        }
+    private:
+        enum { small_words = 16 }; // stack buffer used by single value evaluation
+        enum { block_words = 4 * span_block_size }; // stack buffers of span evaluation
+        // intermediate results go back and forth between the two buffers
+        void run(const X *x, Y *y, size_t n, double *buffer0, double *buffer1) const
+        {
+            const void *src = x;
+            for (size_t s = 0; s < stages_.size(); s++)
+            {
+                void *dest = (s + 1 == stages_.size() ? static_cast<void *>(y) : (s % 2 ? buffer1 : buffer0));
+                stages_[s]->eval_span(src, dest, n);
+                src = dest;
+            }
+        }
+        algo_base_t::stage_list_t stages_;
+        size_t                    max_size_;
+    };
+
+    ///
+    /// @brief Builds a flat equivalent of f, with adjacent stages merged where possible
+    ///
+    template <class Y, class X>
+    function_t<Y, X> optimize(const function_t<Y, X> &f)
+    {
+        algo_base_t::stage_list_t stages;
+        std::shared_ptr<algo_base_t> algo = f.imp();
+        algo->flatten(algo, stages);
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (size_t i = 0; i < stages.size() && stages.size() > 1; i++)
+                if (stages[i]->is_identity())
+                {
+                    stages.erase(stages.begin() + i);
+                    changed = true;
+                    break;
+                }
+            for (size_t i = 1; i < stages.size() && !changed; i++)
+            {
+                std::shared_ptr<algo_base_t> fused(stages[i]->fuse(*stages[i - 1]));
+                if (fused)
+                {
+                    stages[i - 1] = fused;
+                    stages.erase(stages.begin() + i);
+                    changed = true;
+                }
+            }
+        }
+        for (std::shared_ptr<algo_base_t> &stage : stages)
+        {
+            std::shared_ptr<algo_base_t> baked(stage->bake());
+            if (baked)
+                stage = baked;
+        }
+        return function_t<Y, X>(new chain_t<Y, X>(stages));
+    }
+}
+#endif
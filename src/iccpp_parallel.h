@@ -0,0 +1,164 @@
+#ifndef iccpp_parallel_H
+#define iccpp_parallel_H
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <vector>
+#include <algorithm>
+
+/**
+    @file
+    @brief A minimal pool of worker threads used to split work on images and tables
+*/
+namespace iccpp
+{
+    ///
+    /// @class worker_pool_t
+    /// @brief Fixed set of threads executing the tasks of one job at a time.
+    ///        The thread calling run takes part to the job, a run issued from
+    ///        inside a task is executed serially.
+    ///
+    class worker_pool_t
+    {
+    public:
+        typedef std::function<void(size_t)> task_t;
+        ///
+        /// @brief Builds a pool with the given number of threads (caller included),
+        ///        0 means one per hardware thread
+        ///
+        explicit worker_pool_t(size_t threads = 0) : task_(nullptr), tasks_(0), next_(0), done_(0), generation_(0), stop_(false)
+        {
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            for (size_t i = 1; i < threads; i++)
+                workers_.push_back(std::thread([this](){ work(); }));
+        }
+        ~worker_pool_t(void)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            wake_.notify_all();
+            for (std::thread &worker : workers_)
+                worker.join();
+        }
+        worker_pool_t(const worker_pool_t &) = delete;
+        worker_pool_t &operator=(const worker_pool_t &) = delete;
+        size_t size(void) const { return workers_.size() + 1; }
+        ///
+        /// @brief Executes task(i) for i in [0, tasks) and waits for completion.
+        ///        The first exception thrown by a task is rethrown here.
+        ///
+        void run(size_t tasks, const task_t &task)
+        {
+            if (inside_task() || workers_.empty() || tasks < 2)
+            {
+                for (size_t i = 0; i < tasks; i++)
+                    task(i);
+                return;
+            }
+            std::lock_guard<std::mutex> job_lock(job_mutex_);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                task_ = &task;
+                tasks_ = tasks;
+                next_ = 0;
+                done_ = 0;
+                error_ = nullptr;
+                generation_++;
+            }
+            wake_.notify_all();
+            execute();
+            std::unique_lock<std::mutex> lock(mutex_);
+            finished_.wait(lock, [this](){ return done_ == tasks_; });
+            task_ = nullptr;
+            if (error_)
+                std::rethrow_exception(error_);
+        }
+        ///
+        /// @brief A pool shared by the whole process, one thread per core
+        ///
+        static worker_pool_t &instance(void)
+        {
+            static worker_pool_t the_pool;
+            return the_pool;
+        }
+    private:
+        static bool &inside_task(void)
+        {
+            static thread_local bool inside = false;
+            return inside;
+        }
+        void work(void)
+        {
+            size_t generation = 0;
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    wake_.wait(lock, [&](){ return stop_ || generation != generation_; });
+                    if (stop_)
+                        return;
+                    generation = generation_;
+                }
+                execute();
+            }
+        }
+        // takes tasks until the job is exhausted
+        void execute(void)
+        {
+            inside_task() = true;
+            for (;;)
+            {
+                const task_t *task = nullptr;
+                size_t index = 0;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (task_ == nullptr || next_ == tasks_)
+                        break;
+                    task = task_;
+                    index = next_++;
+                }
+                try
+                {
+                    (*task)(index);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (!error_)
+                        error_ = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (++done_ == tasks_)
+                    finished_.notify_all();
+            }
+            inside_task() = false;
+        }
+        std::vector<std::thread> workers_;
+        std::mutex               job_mutex_; // one job at a time
+        std::mutex               mutex_;
+        std::condition_variable  wake_;
+        std::condition_variable  finished_;
+        const task_t            *task_;
+        size_t                   tasks_;
+        size_t                   next_;
+        size_t                   done_;
+        size_t                   generation_;
+        std::exception_ptr       error_;
+        bool                     stop_;
+    };
+}
+#endif
@@ -12,10 +12,13 @@
 
 /// @file iccpp_pixel_traits.h
 /// 
-/// @brief traits required to define a vector_t<T, N> based N-dimensional lookup table
+/// @brief traits required to define a vector_t<T, N> based N-dimensional lookup table,
+///        uniform access to the channels of a pixel
 ///
 
 #include "iccpp_pixel.h"
+#include "iccpp_rgb.h"
+#include "iccpp_clut.h"
 
 namespace iccpp
 {
@@ -24,6 +27,7 @@ namespace iccpp
     {
         typedef T scalar_type;
         typedef typename scalar_traits_t<T>::weight_type weight_type;
+        enum { supported = true };
         static const scalar_type *scalar(const vector_t<T, Dim> &x) { return x.data(); }
         static void split(const vector_t<T, Dim> &x,
             const vector_t<T, Dim> &step,
@@ -38,6 +42,49 @@ namespace iccpp
             iteration_t<T, Dim>::build(base.data(), step, result.data());
             return result;
         }
+        static vector_t<T, Dim> uniform(T value)
+        {
+            return vector_t<T, Dim>(value);
+        }
+    };
+
+    ///
+    /// @brief Uniform access to the channels of a pixel
+    ///
+    template <class P>
+    struct channel_traits_t
+    {
+        enum { supported = false };
+    };
+
+    template <class T, int N>
+    struct channel_traits_t<vector_t<T, N>>
+    {
+        typedef T scalar_type;
+        template <class S> using rebind = vector_t<S, N>;
+        enum { supported = true, channels = N };
+        static T get(const vector_t<T, N> &p, int c) { return p[c]; }
+        static void set(vector_t<T, N> &p, int c, T value) { p[c] = value; }
+    };
+
+    template <class T>
+    struct channel_traits_t<rgb_t<T>>
+    {
+        typedef T scalar_type;
+        template <class S> using rebind = rgb_t<S>;
+        enum { supported = true, channels = 3 };
+        static T get(const rgb_t<T> &p, int c) { return c == 0 ? p.red : (c == 1 ? p.green : p.blue); }
+        static void set(rgb_t<T> &p, int c, T value) { (c == 0 ? p.red : (c == 1 ? p.green : p.blue)) = value; }
+    };
+
+    template <class T>
+    struct channel_traits_t<rgba_t<T>>
+    {
+        typedef T scalar_type;
+        template <class S> using rebind = rgba_t<S>;
+        enum { supported = true, channels = 4 };
+        static T get(const rgba_t<T> &p, int c) { return c == 0 ? p.red : (c == 1 ? p.green : (c == 2 ? p.blue : p.alpha)); }
+        static void set(rgba_t<T> &p, int c, T value) { (c == 0 ? p.red : (c == 1 ? p.green : (c == 2 ? p.blue : p.alpha))) = value; }
     };
 }
 
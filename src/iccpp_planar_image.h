@@ -0,0 +1,205 @@
+#ifndef iccpp_planar_image_H
+#define iccpp_planar_image_H
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include "iccpp_image.h"
+#include "iccpp_fixed_lut.h"
+
+/**
+    @file
+    @brief Planar images: one plane per channel, as produced by RIPs and decoders.
+
+    Transforms work on interleaved pixels, so apply converts blocks of span_block_size
+    pixels of a line into a small buffer, evaluates the span and writes the result
+    back to the planes. Only a block is interleaved at a time, and the buffers stay
+    in the first level cache, so there is no full image copy.
+*/
+namespace iccpp
+{
+    ///
+    /// @class planar_image_t
+    /// @brief Image of pixels of type P stored as one plane of scalars per channel,
+    ///        each plane with its own base address and line stride
+    ///
+    template <class P>
+    class planar_image_t
+    {
+    public:
+        typedef P pixel_type;
+        typedef typename channel_traits_t<P>::scalar_type scalar_type;
+        enum { planes = channel_traits_t<P>::channels };
+        ///
+        /// @brief Image owning its planes, allocated as one block
+        ///
+        planar_image_t(const point_t &size) : size_(size), storage_(new scalar_type[size.x * size.y * planes])
+        {
+            for (int c = 0; c < planes; c++)
+            {
+                planes_[c] = storage_.get() + c * size.x * size.y;
+                line_size_[c] = size.x * sizeof(scalar_type);
+            }
+        }
+        ///
+        /// @brief Image on planes owned by the caller, line_sizes are in bytes
+        ///        (nullptr or 0 means size.x scalars)
+        ///
+        planar_image_t(scalar_type *const *data, const point_t &size, const int *line_sizes = nullptr) : size_(size)
+        {
+            for (int c = 0; c < planes; c++)
+            {
+                planes_[c] = data[c];
+                if (line_sizes == nullptr || line_sizes[c] == 0)
+                    line_size_[c] = size.x * sizeof(scalar_type);
+                else
+                    line_size_[c] = line_sizes[c];
+            }
+        }
+        planar_image_t(const planar_image_t &) = delete;
+        planar_image_t &operator=(const planar_image_t &) = delete;
+        scalar_type *plane(int c, int line)
+        {
+            return reinterpret_cast<scalar_type *>(reinterpret_cast<char *>(planes_[c]) + line_size_[c] * line);
+        }
+        const scalar_type *plane(int c, int line) const
+        {
+            return reinterpret_cast<const scalar_type *>(reinterpret_cast<const char *>(planes_[c]) + line_size_[c] * line);
+        }
+        point_t size(void) const { return size_; }
+        int line_size(int c) const { return line_size_[c]; }
+        ///
+        /// @brief Interleaves n pixels of line starting from column x
+        ///
+        void load(int line, int x, pixel_type *pixels, size_t n) const
+        {
+            for (int c = 0; c < planes; c++)
+            {
+                const scalar_type *src = plane(c, line) + x;
+                for (size_t i = 0; i < n; i++)
+                    channel_traits_t<P>::set(pixels[i], c, src[i]);
+            }
+        }
+        ///
+        /// @brief Scatters n pixels to line starting from column x
+        ///
+        void store(int line, int x, const pixel_type *pixels, size_t n)
+        {
+            for (int c = 0; c < planes; c++)
+            {
+                scalar_type *dest = plane(c, line) + x;
+                for (size_t i = 0; i < n; i++)
+                    dest[i] = channel_traits_t<P>::get(pixels[i], c);
+            }
+        }
+        template <class P1>
+        void apply(const function_t<P, P1> &f, const planar_image_t<P1> &img)
+        {
+            apply_lines(f, img, *this, size_.x, 0, size_.y);
+        }
+        template <class P1>
+        void apply(const function_t<P, P1> &f, const image_t<P1> &img)
+        {
+            apply_lines(f, interleaved_lines_t<const image_t<P1>>(img), *this, size_.x, 0, size_.y);
+        }
+        ///
+        /// @brief Parallel versions of apply: the image is split in bands of rows
+        ///        processed by the threads of pool
+        ///
+        template <class P1>
+        void apply(const function_t<P, P1> &f, const planar_image_t<P1> &img, worker_pool_t &pool)
+        {
+            apply_bands(f, img, *this, size_, pool);
+        }
+        template <class P1>
+        void apply(const function_t<P, P1> &f, const image_t<P1> &img, worker_pool_t &pool)
+        {
+            apply_bands(f, interleaved_lines_t<const image_t<P1>>(img), *this, size_, pool);
+        }
+        template <class F>
+        void apply(const F &f)
+        {
+            apply(f, *this);
+        }
+        template <class F>
+        void apply(const F &f, worker_pool_t &pool)
+        {
+            apply(f, *this, pool);
+        }
+        ///
+        /// @brief Transform of a planar image into an interleaved one
+        ///
+        template <class Y>
+        void apply_to(image_t<Y> &dest, const function_t<Y, P> &f) const
+        {
+            interleaved_lines_t<image_t<Y>> lines(dest);
+            apply_lines(f, *this, lines, size_.x, 0, size_.y);
+        }
+        template <class Y>
+        void apply_to(image_t<Y> &dest, const function_t<Y, P> &f, worker_pool_t &pool) const
+        {
+            interleaved_lines_t<image_t<Y>> lines(dest);
+            apply_bands(f, *this, lines, size_, pool);
+        }
+    private:
+        enum { bands_per_thread = 4 }; // same banding as image_t
+        // load/store on the lines of an interleaved image
+        template <class I>
+        class interleaved_lines_t
+        {
+        public:
+            typedef typename I::pixel_type pixel_type;
+            explicit interleaved_lines_t(I &img) : img_(img) {}
+            void load(int line, int x, pixel_type *pixels, size_t n) const
+            {
+                std::copy(img_[line] + x, img_[line] + x + n, pixels);
+            }
+            void store(int line, int x, const pixel_type *pixels, size_t n)
+            {
+                std::copy(pixels, pixels + n, img_[line] + x);
+            }
+        private:
+            I &img_;
+        };
+        // lines [first, last) of src go to dest, a block of pixels at a time
+        // through buffers on the stack
+        template <class Y, class X, class S, class D>
+        static void apply_lines(const function_t<Y, X> &f, const S &src, D &dest, int width, int first, int last)
+        {
+            X x[span_block_size];
+            Y y[span_block_size];
+            size_t block = std::min(static_cast<size_t>(width), span_block_size);
+            for (int line = first; line < last; line++)
+                for (int i = 0; i < width; i += static_cast<int>(block))
+                {
+                    size_t n = std::min(static_cast<size_t>(width - i), block);
+                    src.load(line, i, x, n);
+                    f.eval_n(x, y, n);
+                    dest.store(line, i, y, n);
+                }
+        }
+        template <class Y, class X, class S, class D>
+        static void apply_bands(const function_t<Y, X> &f, const S &src, D &dest, const point_t &size, worker_pool_t &pool)
+        {
+            size_t rows = static_cast<size_t>(size.y);
+            size_t bands = std::min(rows, pool.size() * bands_per_thread);
+            pool.run(bands, [&](size_t band)
+            {
+                apply_lines(f, src, dest, size.x, static_cast<int>(band * rows / bands), static_cast<int>((band + 1) * rows / bands));
+            });
+        }
+        point_t                        size_;
+        std::unique_ptr<scalar_type[]> storage_;
+        scalar_type                   *planes_[planes];
+        int                            line_size_[planes];
+    };
+}
+#endif
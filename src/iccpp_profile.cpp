@@ -8,10 +8,26 @@
 // http://www.boost.org/LICENSE_1_0.txt)
 //
 #include "iccpp_profile.h"
+#include "iccpp_profile_cache.h"
+#include <algorithm>
 #include <fstream>
+#include <iterator>
+#include <limits>
 #include <vector>
 #include <map>
+#include <mutex>
 #include <string>
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "iccpp_function.h"
 
 //#define DEBUG_ALGO
@@ -27,6 +43,7 @@
 #include "iccpp_curve.h"
 #include "iccpp_rgb.h"
 #include "iccpp_pixel_traits.h"
+#include "iccpp_parallel.h"
 
 namespace iccpp
 {
@@ -61,18 +78,129 @@ namespace iccpp
             icc_uint32_t    offset;
             icc_uint32_t    size;
         };
+        const size_t header_size = 128;   // bytes of profile_header_t in the file
+        const size_t tag_entry_size = 12; // bytes of tag_entry_t in the file
+
+        ///
+        /// @brief Read only bytes of a whole profile.
+        ///
+        /// The base class borrows memory owned by the caller, derived classes
+        /// own a copy of the data or a read only mapping of the file.
+        ///
+        class byte_source_t
+        {
+        public:
+            byte_source_t(const icc_uint8_t *data, size_t size) : data_(data), size_(size) {}
+            byte_source_t(const byte_source_t &) = delete;
+            byte_source_t &operator=(const byte_source_t &) = delete;
+            virtual ~byte_source_t(void) {}
+            const icc_uint8_t *data(void) const { return data_; }
+            size_t size(void) const { return size_; }
+            virtual size_t owned(void) const { return 0; } ///< heap bytes held by the source
+        protected:
+            byte_source_t(void) : data_(nullptr), size_(0) {}
+            const icc_uint8_t *data_;
+            size_t             size_;
+        };
+
+        /// @brief Bytes copied out of a stream, from its current position to the end, or out of a buffer
+        class buffer_source_t : public byte_source_t
+        {
+        public:
+            explicit buffer_source_t(std::istream &ist) :
+                buffer_((std::istreambuf_iterator<char>(ist)), std::istreambuf_iterator<char>())
+            {
+                data_ = reinterpret_cast<const icc_uint8_t *>(buffer_.data());
+                size_ = buffer_.size();
+            }
+            buffer_source_t(const void *data, size_t size) :
+                buffer_(static_cast<const char *>(data), static_cast<const char *>(data) + size)
+            {
+                data_ = reinterpret_cast<const icc_uint8_t *>(buffer_.data());
+                size_ = buffer_.size();
+            }
+            size_t owned(void) const override { return buffer_.capacity(); }
+        private:
+            std::vector<char> buffer_;
+        };
+
+        /// @brief Read only mapping of a file, data() is null if the file cannot be mapped
+        class mapped_file_t : public byte_source_t
+        {
+        public:
+            explicit mapped_file_t(const char *path)
+            {
+#ifdef _WIN32
+                HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, 
+                                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (file == INVALID_HANDLE_VALUE)
+                    return;
+                LARGE_INTEGER size;
+                if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+                {
+                    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                    if (mapping != nullptr)
+                    {
+                        void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                        if (view != nullptr)
+                        {
+                            data_ = static_cast<const icc_uint8_t *>(view);
+                            size_ = static_cast<size_t>(size.QuadPart);
+                        }
+                        CloseHandle(mapping);
+                    }
+                }
+                CloseHandle(file);
+#else
+                int file = open(path, O_RDONLY);
+                if (file < 0)
+                    return;
+                struct stat info;
+                if (fstat(file, &info) == 0 && info.st_size > 0)
+                {
+                    void *view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+                    if (view != MAP_FAILED)
+                    {
+                        data_ = static_cast<const icc_uint8_t *>(view);
+                        size_ = static_cast<size_t>(info.st_size);
+                    }
+                }
+                close(file);
+#endif
+            }
+            ~mapped_file_t(void)
+            {
+                if (data_ == nullptr)
+                    return;
+#ifdef _WIN32
+                UnmapViewOfFile(data_);
+#else
+                munmap(const_cast<icc_uint8_t *>(data_), size_);
+#endif
+            }
+        };
 
+        ///
+        /// @brief Big endian decoder over a byte_source_t
+        ///
+        /// Copies of a reader and readers obtained with operator+ share the same
+        /// cursor, exactly as they used to share the position of a stream.
+        /// Reads are checked against the end of the tag given at construction.
+        ///
         class reader_t
         {
         public:
-            reader_t(std::istream &ist, 
+            reader_t(const byte_source_t &source, 
                      color_space_t out = color_space_t::None, 
                      color_space_t in = color_space_t::None, 
-                     size_t offset = 0) :
-                           ist_(ist), out_(out), in_(in), offset_(offset), dsize_(1)
+                     size_t offset = 0,
+                     size_t size = std::numeric_limits<size_t>::max()) :
+                           data_(source.data()), out_(out), in_(in), offset_(offset), dsize_(1),
+                           cursor_(std::make_shared<cursor_t>())
             {
-                if (offset != 0)
-                    ist.seekg(offset);
+                size_t available = offset < source.size() ? source.size() - offset : 0;
+                cursor_->end = data_ + offset + std::min(size, available);
+                seek(offset);
             }
             reader_t &operator=(const reader_t &) = delete;
             color_space_t in(void) const { return in_; }
@@ -81,9 +209,16 @@ namespace iccpp
             size_t entry_size(void) const { return dsize_; }
             reader_t operator + (int offset)
             {
-                return reader_t(ist_, out_, in_, offset_ + offset);
+                reader_t result(*this);
+                result.offset_ = offset_ + offset;
+                result.dsize_ = 1;
+                result.seek(result.offset_);
+                return result;
             }
             size_t offset(void) const { return offset_; }
+            // bytes of the tables built out of the tag, shared as the cursor
+            void decoded(size_t bytes) { cursor_->decoded += bytes; }
+            size_t decoded(void) const { return cursor_->decoded; }
             template <class T>
             T read(void)
             {
@@ -91,12 +226,16 @@ namespace iccpp
                 (*this)(result);
                 return result;
             }
+            // raw access to the next bytes, valid as long as the source
+            const icc_uint8_t *bytes(size_t count)
+            {
+                return take(count);
+            }
             void zero(size_t bytes)
             {
-                char data[32];
                 if (bytes > 32)
                     bytes = 32;
-                ist_.read(data, bytes);
+                const icc_uint8_t *data = take(bytes);
                 for (size_t i = 0; i < bytes; i++)
                 if (data[i] != 0)
                     throw icc_file_exception_t("Nonzero padding");
@@ -169,29 +308,48 @@ namespace iccpp
             template <int N>
             void operator()(unsigned char(&value)[N])
             {
-                ist_.read(reinterpret_cast<char *>(&value[0]), N);
+                memcpy(&value[0], take(N), N);
             }
             template <int N>
             void operator()(signed char(&value)[N])
             {
-                ist_.read(reinterpret_cast<char *>(&value[0]), N);
+                memcpy(&value[0], take(N), N);
             }
         private:
+            struct cursor_t
+            {
+                const icc_uint8_t *pos;
+                const icc_uint8_t *end;
+                size_t             decoded = 0;
+            };
+            void seek(size_t offset)
+            {
+                // an offset past the end is only an error if something is read there
+                cursor_->pos = data_ + offset;
+            }
+            const icc_uint8_t *take(size_t bytes)
+            {
+                const icc_uint8_t *result = cursor_->pos;
+                if (result > cursor_->end || static_cast<size_t>(cursor_->end - result) < bytes)
+                    throw icc_file_exception_t("Read past the end of tag");
+                cursor_->pos += bytes;
+                return result;
+            }
             template <class T>
             T integer(void)
             {
-                unsigned char value[sizeof(T)];
-                ist_.read(reinterpret_cast<char *>(value), sizeof(T));
+                const icc_uint8_t *value = take(sizeof(T));
                 T result = 0;
                 for (int i = 0; i < sizeof(T); i++)
                     result = (result << 8) + value[i];
                 return result;
             }
-            std::istream &ist_;
-            color_space_t out_;
-            color_space_t in_;
-            size_t        offset_;
-            size_t        dsize_; // normalized way of reading 
+            const icc_uint8_t          *data_;
+            color_space_t               out_;
+            color_space_t               in_;
+            size_t                      offset_;
+            size_t                      dsize_; // normalized way of reading 
+            std::shared_ptr<cursor_t>   cursor_;
         };
 
         template <class S>
@@ -356,6 +514,7 @@ namespace iccpp
             {
                 algo_ = algo;
                 output_ = output; 
+                result_ = nullptr; // domains out of the type list are not supported
             }
             tag_content_base_t *result(void) { return result_; }
             template <class D>
@@ -517,8 +676,8 @@ namespace iccpp
         class profile_imp_t : public profile_t
         {
         public:
-            profile_imp_t(const profile_header_t &header, std::unique_ptr<std::ifstream> &stream) :
-                header_(header), stream_(std::move(stream))
+            profile_imp_t(const profile_header_t &header, const std::shared_ptr<byte_source_t> &source) :
+                header_(header), source_(source), decoded_(0)
             {}
             virtual color_space_t pcs(void) const override
             {
@@ -528,47 +687,58 @@ namespace iccpp
             {
                 return header_.color_space;
             }
+            // the instance, its tag table, the tables and curves decoded so far and
+            // the copy of the profile bytes if any: borrowed or mapped bytes are not counted
+            virtual size_t footprint(void) const override
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return sizeof(*this) + tags_.size() * sizeof(tag_entry_t) + decoded_ + source_->owned();
+            }
             void load_index(void)
             {
                 icc_uint32_t tags = 0;
-                reader_t reader(*stream_);
+                reader_t reader(*source_, color_space_t::None, color_space_t::None, header_size);
 
                 reader(tags);
+                if (tags > (source_->size() - header_size) / tag_entry_size)
+                    throw icc_file_exception_t("Cannot read tags table");
                 for (icc_uint32_t i = 0; i < tags; i++)
                 {
                     tag_entry_t tag;
                     exx(reader, tag);
-                    if (*stream_)
-                        tags_.push_back(tag);
-                    else
-                        throw icc_file_exception_t("Cannot read tags table");
+                    tags_.push_back(tag);
                 }
             }
             void list_tags(std::ostream &ost) const override
             {
                 for (const tag_entry_t &tag : tags_)
                 {
-                    char type[4];
                     std::string signature(reinterpret_cast<const char *>(&tag.signature), 4);
-                    stream_->seekg(tag.offset);
-                    stream_->read(type, 4);
-                    ost << signature << " -> " << std::string(type, 4) << "\n";
+                    std::string type("????");
+                    if (tag.offset <= source_->size() && source_->size() - tag.offset >= 4)
+                        type.assign(reinterpret_cast<const char *>(source_->data() + tag.offset), 4);
+                    ost << signature << " -> " << type << "\n";
                 }
             }
-            /*
             virtual void load_tag(tag_signature_t signature) override
             {
-                load_tag_imp(signature);
+                load_tag_imp(signature, is_pcs2dev(signature));
             }
+            ///
+            /// @brief Decodes the rendering tags present in the profile, one task
+            ///        per tag on the process wide worker pool
+            ///
             virtual void load_all(void) override
             {
-                for (const tag_entry_t &tag : tags_)
-                {
-                    reader_t reader(*stream_, tag.offset);
-                    load_tag(reader, tag.signature);
-                }
+                static const tag_signature_t sc_rendering[] = { tag_signature_t::AToB0Tag, tag_signature_t::AToB1Tag,
+                                                                tag_signature_t::AToB2Tag, tag_signature_t::BToA0Tag,
+                                                                tag_signature_t::BToA1Tag, tag_signature_t::BToA2Tag };
+                std::vector<tag_signature_t> signatures;
+                for (tag_signature_t signature : sc_rendering)
+                    if (has_tag(signature))
+                        signatures.push_back(signature);
+                worker_pool_t::instance().run(signatures.size(), [&](size_t i) { load_tag(signatures[i]); });
             }
-            */
         private:
             virtual std::shared_ptr<algo_base_t> dev2pcs(rendering_intent_t intent) override
             { // 'A' is device side, 'B' is PCS
@@ -621,18 +791,49 @@ namespace iccpp
                 else
                     return nullptr;
             }
+            // instances are shared by profile_cache_t and tags are loaded by
+            // concurrent tasks: decoding runs out of the lock, the first result stored wins
             tag_content_ptr_t load_tag_imp(tag_signature_t signature, bool pcs2dev)
             {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    auto it = contents_.find(signature);
+                    if (it != contents_.end())
+                        return it->second;
+                }
                 for (const tag_entry_t &tag : tags_)
                     if (tag.signature == signature)
                     {
                         color_space_t in = pcs2dev ? header_.pcs : header_.color_space;
                         color_space_t out = pcs2dev ? header_.color_space : header_.pcs;
-                        reader_t reader(*stream_, out, in, tag.offset);
-                        return load_tag(reader, signature);
+                        reader_t reader(*source_, out, in, tag.offset, tag.size);
+                        tag_content_ptr_t content = load_tag(reader);
+                        if (!content)
+                            return content;
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        auto inserted = contents_.insert(std::make_pair(signature, content));
+                        if (inserted.second)
+                            decoded_ += reader.decoded();
+                        return inserted.first->second;
                     }
                 return tag_content_ptr_t();
             }
+            static bool is_pcs2dev(tag_signature_t signature)
+            {
+                switch (signature)
+                {
+                case tag_signature_t::BToA0Tag:
+                case tag_signature_t::BToA1Tag:
+                case tag_signature_t::BToA2Tag:
+                case tag_signature_t::BToD0Tag:
+                case tag_signature_t::BToD1Tag:
+                case tag_signature_t::BToD2Tag:
+                case tag_signature_t::BToD3Tag:
+                    return true;
+                default:
+                    return false;
+                }
+            }
             bool has_tag(tag_signature_t signature)
             {
                 for (const tag_entry_t &tag : tags_)
@@ -647,12 +848,9 @@ namespace iccpp
                 reader.zero(4);
                 return tag_type;
             }
-            tag_content_ptr_t load_tag(reader_t &reader, tag_signature_t signature)
+            tag_content_ptr_t load_tag(reader_t &reader)
             {
                 tag_content_ptr_t content;
-                auto it = contents_.find(signature);
-                if (it != contents_.end())
-                    return it->second;
                 tag_type_t tag = get_tag(reader);
                 switch (tag)
                 {
@@ -678,8 +876,6 @@ namespace iccpp
                 default:
                     break;
                 }
-                if (content)
-                    contents_[signature] = content;
                 return content;
             }
             template <class Tag>
@@ -826,6 +1022,7 @@ namespace iccpp
                     std::vector<double> knots;
                     for (icc_uint32_t i = 0; i < count; i++)
                         knots.push_back(reader.read_u0f16());
+                    reader.decoded(knots.size() * sizeof(double));
                     return new icc_curve_interpolated_t(knots);
                 }
             }
@@ -862,6 +1059,7 @@ namespace iccpp
                     std::vector<double> knots;
                     for (icc_uint32_t i = 0; i < grids; i++)
                         knots.push_back(reader.read<double>());
+                    reader.decoded(knots.size() * sizeof(double));
                     components[index] = new icc_curve_interpolated_t(knots);
                 }
                 return new icc_curve_t<Dimension>(components);
@@ -890,39 +1088,132 @@ namespace iccpp
                     result[i] = 1.0 / (gridpoints[i] - 1);
                 return result;
             }
-            // Lab uses multilinear interpolation.
+            // Lab uses multilinear interpolation, except for the 4-input CMYK tables
+            // that go to the simplex kernel.
             // Here is better to switch to a run time check, this way to work
             // is a symptom of metaprogramming addiction...
             template <class Y, class X>
             algo_t<Y, X> *build_clut1(reader_t &reader, const X &step,  size_t *gridpoints)
             {
-                if (header_.pcs == color_space_t::LabData)
+                bool cmyk = X::dimension == 4 && reader.in() == color_space_t::CmykData;
+                if (!cmyk && header_.pcs == color_space_t::LabData)
                     return build_clut2<Y, X, interp_multi_t>(reader, step, gridpoints);
                 else
                     return build_clut2<Y, X, interp_tetra_t>(reader, step, gridpoints);
             }
-            // this is required because inside ICC profile the indexing scheme is different
-            size_t revindex(size_t i, const size_t *gridpoints, size_t n)
+            // decodes count big endian samples of size bytes each into [0, 1].
+            // Samples go by blocks of a constant count through a local buffer, which
+            // cannot alias the bytes: the compiler vectorizes the byte swap and the
+            // scaling even at -O2, with no run time overlap check
+            static void decode_samples(const icc_uint8_t *data, size_t size, size_t count, double *result)
             {
-                size_t result = 0;
-                for (size_t j = 0; j < n; j++)
+                enum { block = 16 };
+                double values[block];
+                size_t k = 0;
+                if (size == 1)
                 {
-                    if (j > 0)
-                        result *= gridpoints[j];
-                    result += i % gridpoints[j];
-                    i /= gridpoints[j];
+                    for (; k + block <= count; k += block)
+                    {
+                        for (size_t j = 0; j < block; j++)
+                            values[j] = data[k + j] / 255.0;
+                        std::copy(values, values + block, result + k);
+                    }
+                    for (; k < count; k++)
+                        result[k] = data[k] / 255.0;
+                }
+                else
+                {
+                    for (; k + block <= count; k += block)
+                    {
+                        const icc_uint8_t *bytes = data + 2 * k;
+                        for (size_t j = 0; j < block; j++)
+                            values[j] = ((bytes[2 * j] << 8) | bytes[2 * j + 1]) / 65535.0;
+                        std::copy(values, values + block, result + k);
+                    }
+                    for (; k < count; k++)
+                        result[k] = ((data[2 * k] << 8) | data[2 * k + 1]) / 65535.0;
                 }
-                return result;
             }
             // fill in CLUT data
+            // Inside ICC profile the indexing scheme is different: the digits of the
+            // sample number are reversed in the table index. An odometer over the
+            // digits keeps the table index up to date, so no division is required.
+            template <class L>
+            L *fill_clut(reader_t &reader, L *lut, const size_t *gridpoints)
+            {
+                typedef typename L::range_type Y;
+                const size_t inputs = L::dimension;
+                const size_t channels = Y::dimension;
+                std::unique_ptr<L> result(lut);
+                size_t size = reader.entry_size();
+                if (size != 1 && size != 2)
+                    throw icc_file_exception_t("Invalid clut element size");
+                size_t samples = result->datasize();
+                const icc_uint8_t *data = reader.bytes(samples * channels * size);
+                reader.decoded(samples * sizeof(Y));
+
+                size_t stride[inputs]; // table stride of each digit of the sample number
+                size_t digits[inputs];
+                stride[inputs - 1] = 1;
+                for (size_t j = inputs - 1; j > 0; j--)
+                    stride[j - 1] = stride[j] * gridpoints[j];
+                arithmetic_t<size_t, inputs>::assign(digits, 0);
+
+                // the lowest digit runs along contiguous samples
+                size_t run = gridpoints[0];
+                std::vector<double> values(run * channels);
+                size_t base = 0;
+                for (size_t i = 0; i < samples; i += run)
+                {
+                    decode_samples(data, size, values.size(), values.data());
+                    data += values.size() * size;
+                    const double *value = values.data();
+                    for (size_t k = 0; k < run; k++, value += channels)
+                    {
+                        Y &entry = (*result)[static_cast<int>(base + k * stride[0])];
+                        for (size_t c = 0; c < channels; c++)
+                            entry[static_cast<int>(c)] = value[c];
+                    }
+                    for (size_t j = 1; j < inputs; j++)
+                    {
+                        base += stride[j];
+                        if (++digits[j] < gridpoints[j])
+                            break;
+                        base -= gridpoints[j] * stride[j];
+                        digits[j] = 0;
+                    }
+                }
+                return result.release();
+            }
             template <class Y, class X, class I>
             algo_t<Y, X> *build_clut2(reader_t &reader, const X &step, const size_t *gridpoints)
             {
-                lut_t<Y, X, I> *result = new lut_t<Y, X, I>(gridpoints, step);
-                size_t samples = result->datasize();
-                for (size_t i = 0; i < samples; i++)
-                    (*result)[revindex(i, gridpoints, X::dimension)] = reader.read<Y>();
-                 return result;
+                algo_t<Y, X> *result = build_fixed_grid_clut<Y, X, I>(reader, gridpoints,
+                    std::integral_constant<bool, X::dimension == 3 || X::dimension == 4>());
+                if (result == nullptr)
+                    result = fill_clut(reader, new lut_t<Y, X, I>(gridpoints, step), gridpoints);
+                return result;
+            }
+            // RGB and CMYK tables almost always have 17, 33 or 65 points on every axis:
+            // these get a fixed_grid_lut_t, nullptr means the grid is not one of them
+            template <class Y, class X, class I>
+            algo_t<Y, X> *build_fixed_grid_clut(reader_t &, const size_t *, std::false_type)
+            {
+                return nullptr;
+            }
+            template <class Y, class X, class I>
+            algo_t<Y, X> *build_fixed_grid_clut(reader_t &reader, const size_t *gridpoints, std::true_type)
+            {
+                for (size_t i = 1; i < X::dimension; i++)
+                    if (gridpoints[i] != gridpoints[0])
+                        return nullptr;
+                switch (gridpoints[0])
+                {
+                case 17: return fill_clut(reader, new fixed_grid_lut_t<Y, X, 17, I>(), gridpoints);
+                case 33: return fill_clut(reader, new fixed_grid_lut_t<Y, X, 33, I>(), gridpoints);
+                case 65: return fill_clut(reader, new fixed_grid_lut_t<Y, X, 65, I>(), gridpoints);
+                default: return nullptr;
+                }
             }
             // read matrix sections.
             // It's a templat but actually just the 3x3 case is used.
@@ -953,9 +1244,11 @@ namespace iccpp
                 return result.release();
             }
             profile_header_t                    header_;
-            std::unique_ptr<std::ifstream>      stream_;
+            std::shared_ptr<byte_source_t>      source_;
             std::vector<tag_entry_t>            tags_;
             std::map<tag_signature_t, tag_content_ptr_t> contents_;
+            size_t                              decoded_; // bytes of the contents
+            mutable std::mutex                  mutex_;
         };
 
         class profile_srgb_t : public profile_t
@@ -980,15 +1273,112 @@ namespace iccpp
             std::shared_ptr<algo_t<xyz_t, rgb_t<double>>>   rgb2xyz_;
             std::shared_ptr<algo_t<rgb_t<double>, xyz_t>>   xyz2rgb_;
         };
+
+        // profile ID of the header, or a hash of the whole content when the ID is zero
+        std::string profile_key(const byte_source_t &source)
+        {
+            const size_t id_offset = 84;
+            const size_t id_size = 16;
+            if (source.data() == nullptr || source.size() < header_size)
+                return std::string();
+            const icc_uint8_t *id = source.data() + id_offset;
+            if (std::any_of(id, id + id_size, [](icc_uint8_t b) { return b != 0; }))
+                return std::string(1, 'I') + std::string(reinterpret_cast<const char *>(id), id_size);
+            // 64 bit FNV-1a, the size is part of the key as well
+            icc_uint64_t hash = 14695981039346656037ULL;
+            for (size_t i = 0; i < source.size(); i++)
+                hash = (hash ^ source.data()[i]) * 1099511628211ULL;
+            icc_uint64_t values[2] = { hash, source.size() };
+            return std::string(1, 'H') + std::string(reinterpret_cast<const char *>(values), sizeof(values));
+        }
+
+        // size and modification time of a file followed by its path, empty if the file cannot be found
+        std::string file_stamp(const char *path)
+        {
+            icc_uint64_t values[3] = { 0, 0, 0 };
+#ifdef _WIN32
+            WIN32_FILE_ATTRIBUTE_DATA info;
+            if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info))
+                return std::string();
+            values[0] = (static_cast<icc_uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+            values[1] = (static_cast<icc_uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | 
+                        info.ftLastWriteTime.dwLowDateTime;
+#else
+            struct stat info;
+            if (stat(path, &info) != 0)
+                return std::string();
+            values[0] = static_cast<icc_uint64_t>(info.st_size);
+            values[1] = static_cast<icc_uint64_t>(info.st_mtime);
+#ifdef __linux__
+            values[2] = static_cast<icc_uint64_t>(info.st_mtim.tv_nsec);
+#endif
+#endif
+            return std::string(1, 'F') + std::string(reinterpret_cast<const char *>(values), sizeof(values)) + path;
+        }
+
+        profile_t *create_profile(const std::shared_ptr<byte_source_t> &source)
+        {
+            if (source->data() == nullptr || source->size() < header_size)
+                return nullptr;
+            reader_t reader(*source, color_space_t::None, color_space_t::None, 0, header_size);
+            profile_header_t header;
+
+            exx(reader, header);
+
+            if (header.magic != static_cast<int>(specials_t::MagicNumber))
+                return 0;
+            std::unique_ptr<profile_imp_t> result(new profile_imp_t(header, source));
+            result->load_index();
+            return result.release() ;
+        }
     } // namespace loader
 
 
     profile_t *profile_t::create(const char *file)
     {
-        std::unique_ptr<std::ifstream> stream(new std::ifstream(file, std::ios_base::binary));
-        if (!stream)
+        return loader::create_profile(std::make_shared<loader::mapped_file_t>(file));
+    }
+
+    profile_t *profile_t::create(const void *data, size_t size)
+    {
+        return loader::create_profile(std::make_shared<loader::byte_source_t>(static_cast<const icc_uint8_t *>(data), size));
+    }
+
+    profile_cache_t &profile_cache_t::instance(void)
+    {
+        static profile_cache_t the_cache;
+        return the_cache;
+    }
+
+    // a file seen before with the same size and time is found without reading it
+    std::shared_ptr<profile_t> profile_cache_t::get(const char *file)
+    {
+        std::string stamp = loader::file_stamp(file);
+        if (stamp.empty())
+            return nullptr;
+        std::shared_ptr<profile_t> result = find_file(stamp);
+        if (result)
+            return result;
+        std::shared_ptr<loader::byte_source_t> source(std::make_shared<loader::mapped_file_t>(file));
+        std::string key = loader::profile_key(*source);
+        if (key.empty())
             return nullptr;
-        return profile_t::create(stream);
+        result = find(key, stamp);
+        if (result)
+            return result;
+        return insert(key, loader::create_profile(source), stamp);
+    }
+
+    std::shared_ptr<profile_t> profile_cache_t::get(const void *data, size_t size)
+    {
+        std::string key = loader::profile_key(loader::byte_source_t(static_cast<const icc_uint8_t *>(data), size));
+        if (key.empty())
+            return nullptr;
+        std::shared_ptr<profile_t> result = find(key);
+        if (result)
+            return result;
+        // a cached profile outlives the caller buffer
+        return insert(key, loader::create_profile(std::make_shared<loader::buffer_source_t>(data, size)));
     }
 
     profile_t *profile_t::create_sRGB(void)
@@ -998,15 +1388,10 @@ namespace iccpp
 
     profile_t *profile_t::create(std::unique_ptr<std::ifstream> &stream)
     {
-        loader::reader_t reader(*stream);
-        profile_header_t header;
-
-        exx(reader, header);
-
-        if (header.magic != static_cast<int>(specials_t::MagicNumber))
-            return 0;
-        std::unique_ptr<loader::profile_imp_t> result(new loader::profile_imp_t(header, stream));
-        result->load_index();
-        return result.release() ;
+        if (!stream || !*stream)
+            return nullptr;
+        std::shared_ptr<loader::byte_source_t> source(std::make_shared<loader::buffer_source_t>(*stream));
+        stream.reset();
+        return loader::create_profile(source);
     }
 }
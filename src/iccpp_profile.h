@@ -55,14 +55,16 @@ namespace iccpp
     {
     public:
         static profile_t *create_sRGB(void); ///< Construction of a standard case
-        static profile_t *create(const char *); ///< Constructor from file path
-        static profile_t *create(std::unique_ptr<std::ifstream> &); ///< Constructor from file path
+        static profile_t *create(const char *); ///< Constructor from file path, the file is memory mapped
+        static profile_t *create(std::unique_ptr<std::ifstream> &); ///< Constructor from an open stream, read in memory
+        static profile_t *create(const void *, size_t); ///< Constructor from bytes that must outlive the profile
         virtual ~profile_t(void) {}
         virtual color_space_t pcs(void) const = 0;
         virtual color_space_t device(void) const = 0;
         virtual void list_tags(std::ostream &) const {}
-        virtual void load_all(void) {}
-        virtual void load_tag(tag_signature_t) {}
+        virtual size_t footprint(void) const { return 0; } ///< bytes held by the instance, its copy of the profile and the tags decoded so far
+        virtual void load_all(void) {} ///< decodes in advance the tags used to build transforms
+        virtual void load_tag(tag_signature_t) {} ///< decodes in advance one tag
         template <class Y, class X>
         static function_t<Y, X> extract_casted(std::shared_ptr<algo_base_t> algo)
         {
@@ -70,28 +72,49 @@ namespace iccpp
             return function_t<Y, X>(result);
         }
         template <class Y, class X>
-        function_t<Y, X> pcs2device(rendering_intent_t intent = rendering_intent_t::relative_colorimetric)
+        static function_t<Y, X> with_options(const function_t<Y, X> &f, const transform_options_t &options)
+        {
+            if (!f.imp())
+                return f;
+            return apply_options(f, options);
+        }
+        template <class Y, class X>
+        function_t<Y, X> pcs2device(rendering_intent_t intent = rendering_intent_t::relative_colorimetric,
+                                    const transform_options_t &options = transform_options_t())
         {
             std::shared_ptr<algo_base_t> algo = pcs2dev(intent);
             if (algo)
             {
                 std::shared_ptr<algo_base_t> domain_adapted(adapt_domain<X>(algo)); // domain is known
                 if (domain_adapted)
-                    return extract_casted<Y, X>(adapt_range2<Y, X>(domain_adapted));
+                    return with_options(extract_casted<Y, X>(adapt_range2<Y, X>(domain_adapted)), options);
             }
-            return function_t<Y, X>(std::dynamic_pointer_cast<algo_t<Y, X>>(algo));
+            return with_options(function_t<Y, X>(std::dynamic_pointer_cast<algo_t<Y, X>>(algo)), options);
         }
         template <class Y, class X>
-        function_t<Y, X> device2pcs(rendering_intent_t intent = rendering_intent_t::relative_colorimetric)
+        function_t<Y, X> device2pcs(rendering_intent_t intent = rendering_intent_t::relative_colorimetric,
+                                    const transform_options_t &options = transform_options_t())
         {
             std::shared_ptr<algo_base_t> algo = dev2pcs(intent);
             if (algo)
             {
                 std::shared_ptr<algo_base_t> range_adapted(adapt_range<Y>(algo)); // domain is handled, since is a fairly standard space
                 if (range_adapted)
-                    return extract_casted<Y, X>(adapt_domain2<Y, X>(range_adapted));
+                    return with_options(extract_casted<Y, X>(adapt_domain2<Y, X>(range_adapted)), options);
             }
-            return function_t<Y, X>(std::dynamic_pointer_cast<algo_t<Y, X>>(algo));
+            return with_options(function_t<Y, X>(std::dynamic_pointer_cast<algo_t<Y, X>>(algo)), options);
+        }
+        /// @brief Transform from the device space of input to the device space of output
+        template <class Y, class X>
+        static function_t<Y, X> transform(profile_t &output, profile_t &input,
+                                          rendering_intent_t intent = rendering_intent_t::relative_colorimetric,
+                                          const transform_options_t &options = transform_options_t())
+        {
+            std::shared_ptr<algo_base_t> pcs2dev_algo = output.pcs2dev(intent);
+            std::shared_ptr<algo_base_t> dev2pcs_algo = input.dev2pcs(intent);
+            if (!pcs2dev_algo || !dev2pcs_algo)
+                return function_t<Y, X>(std::shared_ptr<algo_t<Y, X>>());
+            return function_t<Y, X>(transform_t::create<Y, X>(pcs2dev_algo, dev2pcs_algo, options));
         }
     protected:
         virtual std::shared_ptr<algo_base_t> dev2pcs(rendering_intent_t) = 0; ///< helps building PCS to device transform
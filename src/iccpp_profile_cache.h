@@ -0,0 +1,179 @@
+#ifndef iccpp_profile_cache_H
+#define iccpp_profile_cache_H
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "iccpp_profile.h"
+
+/**
+    @file
+    @brief A process wide registry that shares loaded profiles
+*/
+namespace iccpp
+{
+    const size_t profile_cache_budget = 64 << 20; ///< default byte budget of profile_cache_t
+
+    ///
+    /// @class profile_cache_t
+    /// @brief Thread safe registry of loaded profiles.
+    ///
+    /// Profiles are keyed by the profile ID of their header, or by a hash of the
+    /// whole content when the ID is zero. Files are also found by path, size and
+    /// modification time, so that a file seen before is neither mapped nor hashed
+    /// again. Instances are shared, so the tags built for one user are reused by
+    /// all the others. The footprint of a profile is the size of its decoded tags
+    /// and of the copy of bytes given by address, updated at each lookup: when the total exceeds the budget the least recently
+    /// used profiles are dropped, users still holding them are not affected.
+    ///
+    class profile_cache_t
+    {
+    public:
+        explicit profile_cache_t(size_t budget = profile_cache_budget) : budget_(budget), footprint_(0) {}
+        profile_cache_t(const profile_cache_t &) = delete;
+        profile_cache_t &operator=(const profile_cache_t &) = delete;
+        static profile_cache_t &instance(void); ///< the process wide cache
+        std::shared_ptr<profile_t> get(const char *); ///< from file path, nullptr if not a profile
+        std::shared_ptr<profile_t> get(const void *, size_t); ///< from bytes, copied if the profile is cached
+        ///
+        /// @brief get followed by load_all: meant for service startup, so that the
+        ///        first transform request does not pay the decoding of the tags
+        ///
+        std::shared_ptr<profile_t> prewarm(const char *file)
+        {
+            return loaded(get(file));
+        }
+        std::shared_ptr<profile_t> prewarm(const void *data, size_t size)
+        {
+            return loaded(get(data, size));
+        }
+        void budget(size_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            budget_ = bytes;
+            evict();
+        }
+        size_t budget(void) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return budget_;
+        }
+        size_t footprint(void) const ///< bytes held by the cached profiles
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return footprint_;
+        }
+        size_t size(void) const ///< number of cached profiles
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return entries_.size();
+        }
+        void clear(void)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_.clear();
+            index_.clear();
+            files_.clear();
+            footprint_ = 0;
+        }
+    private:
+        // the tags decoded by load_all are charged at once, not at the next lookup
+        std::shared_ptr<profile_t> loaded(std::shared_ptr<profile_t> profile)
+        {
+            if (!profile)
+                return profile;
+            profile->load_all();
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto it = entries_.begin(); it != entries_.end(); ++it)
+                if (it->profile == profile)
+                    return touch(it, std::string());
+            return profile;
+        }
+        struct entry_t
+        {
+            std::string                key;
+            std::shared_ptr<profile_t> profile;
+            size_t                     footprint; // charged to the cache at the last lookup
+            std::vector<std::string>   files;     // stamps of the files holding the profile
+        };
+        typedef std::list<entry_t> entries_t;
+
+        // lock must be held: entry moved to the front and charged its current footprint
+        std::shared_ptr<profile_t> touch(entries_t::iterator it, const std::string &file)
+        {
+            entries_.splice(entries_.begin(), entries_, it);
+            if (!file.empty() && files_.insert(std::make_pair(file, it)).second)
+                it->files.push_back(file);
+            std::shared_ptr<profile_t> result = it->profile;
+            size_t footprint = result->footprint();
+            footprint_ += footprint - it->footprint;
+            it->footprint = footprint;
+            evict();
+            return result;
+        }
+        std::shared_ptr<profile_t> find(const std::string &key, const std::string &file = std::string())
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = index_.find(key);
+            if (it == index_.end())
+                return nullptr;
+            return touch(it->second, file);
+        }
+        std::shared_ptr<profile_t> find_file(const std::string &file)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = files_.find(file);
+            if (it == files_.end())
+                return nullptr;
+            return touch(it->second, std::string());
+        }
+        // profiles are built out of the lock, the first one inserted wins
+        std::shared_ptr<profile_t> insert(const std::string &key, profile_t *profile, 
+                                          const std::string &file = std::string())
+        {
+            std::shared_ptr<profile_t> result(profile);
+            if (!result)
+                return result;
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = index_.find(key);
+            if (it != index_.end())
+                return touch(it->second, file);
+            entry_t entry = { key, result, 0, std::vector<std::string>() };
+            entries_.push_front(entry);
+            index_[key] = entries_.begin();
+            return touch(entries_.begin(), file);
+        }
+        // lock must be held
+        void evict(void)
+        {
+            while (footprint_ > budget_ && !entries_.empty())
+            {
+                const entry_t &entry = entries_.back();
+                footprint_ -= entry.footprint;
+                for (const std::string &file : entry.files)
+                    files_.erase(file);
+                index_.erase(entry.key);
+                entries_.pop_back();
+            }
+        }
+        mutable std::mutex                          mutex_;
+        size_t                                      budget_;
+        size_t                                      footprint_;
+        entries_t                                   entries_; // most recently used first
+        std::map<std::string, entries_t::iterator>  index_;
+        std::map<std::string, entries_t::iterator>  files_; // by file stamp
+    };
+}
+#endif
@@ -16,6 +16,7 @@ namespace iccpp
     struct rgba_t
     {
         using scalar_type = Channel;
+        enum { dimension = 4 };
         scalar_type red;
         scalar_type green;
         scalar_type blue;
@@ -15,6 +15,7 @@
 /// @brief traits required to define a RGB based 3-dimensional lookup table
 ///
 
+#include "iccpp_clut.h"
 #include "iccpp_rgb.h"
 
 namespace iccpp
@@ -28,6 +29,7 @@ namespace iccpp
     {
         typedef T scalar_type;
         typedef typename scalar_traits_t<T>::weight_type weight_type;
+        enum { supported = true };
         //static const scalar_type *scalar(const rgb_t<T> &x) { return &x.red; }
         static void split(const rgb_t<T> &x,
             const rgb_t<T> &step,
@@ -44,6 +46,10 @@ namespace iccpp
                 static_cast<T>(base.green * step[1]),
                 static_cast<T>(base.blue  * step[2]));
         }
+        static rgb_t<T> uniform(T value)
+        {
+            return rgb_t<T>(value, value, value);
+        }
         static void split_0(T x, T step, delta_item_t<weight_type> *deltas, const size_t *size1)
         {
             T div = x / step;
@@ -0,0 +1,471 @@
+#ifndef iccpp_stream_transform_H
+#define iccpp_stream_transform_H
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <cctype>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#endif
+#include "iccpp_function.h"
+#include "iccpp_parallel.h"
+#include "iccpp_fixed_lut.h"
+
+/**
+    @file
+    @brief Streaming transform of raster files too large to be held in memory.
+
+    The image is processed in chunks of lines going through three stages running
+    concurrently: a thread reads chunk N+1 while the caller transforms chunk N and
+    another thread writes chunk N-1. The chunk buffers are allocated once, so memory
+    is bounded by the chunk size whatever the image size.
+    Supported formats are raw interleaved pixels (native byte order) and binary
+    PPM (P6) and PAM (P7) with 8 or 16 bit channels (big endian, as the formats require).
+*/
+namespace iccpp
+{
+    ///
+    /// @class raster_exception_t
+    /// @brief Exception thrown on malformed or truncated raster data and I/O errors
+    ///
+    class raster_exception_t : public std::runtime_error
+    {
+    public:
+        raster_exception_t(const char *msg) : std::runtime_error(msg) {}
+    };
+
+    ///
+    /// @class raster_io_t
+    /// @brief Byte source and sink of the streaming transform
+    ///
+    class raster_io_t
+    {
+    public:
+        virtual ~raster_io_t(void) {}
+        virtual size_t read(void *data, size_t size) = 0; ///< less than size only at the end of data
+        virtual void write(const void *data, size_t size) = 0;
+    };
+
+    class stream_raster_io_t : public raster_io_t
+    {
+    public:
+        stream_raster_io_t(std::istream &ist) : ist_(&ist), ost_(nullptr) {}
+        stream_raster_io_t(std::ostream &ost) : ist_(nullptr), ost_(&ost) {}
+        virtual size_t read(void *data, size_t size) override
+        {
+            if (ist_ == nullptr)
+                throw raster_exception_t("Stream not open for reading");
+            ist_->read(static_cast<char *>(data), size);
+            return static_cast<size_t>(ist_->gcount());
+        }
+        virtual void write(const void *data, size_t size) override
+        {
+            if (ost_ == nullptr || !ost_->write(static_cast<const char *>(data), size))
+                throw raster_exception_t("Cannot write to stream");
+        }
+    private:
+        std::istream *ist_;
+        std::ostream *ost_;
+    };
+
+    ///
+    /// @class fd_raster_io_t
+    /// @brief I/O on a file descriptor (pipes and sockets included), not closed at the end
+    ///
+    class fd_raster_io_t : public raster_io_t
+    {
+    public:
+        explicit fd_raster_io_t(int fd) : fd_(fd) {}
+        virtual size_t read(void *data, size_t size) override
+        {
+            size_t done = 0;
+            while (done < size)
+            {
+#ifdef _WIN32
+                int count = _read(fd_, static_cast<char *>(data) + done, static_cast<unsigned>(std::min<size_t>(size - done, 1 << 30)));
+#else
+                ssize_t count = ::read(fd_, static_cast<char *>(data) + done, size - done);
+                if (count < 0 && errno == EINTR)
+                    continue;
+#endif
+                if (count < 0)
+                    throw raster_exception_t("Cannot read from file descriptor");
+                if (count == 0)
+                    break;
+                done += static_cast<size_t>(count);
+            }
+            return done;
+        }
+        virtual void write(const void *data, size_t size) override
+        {
+            size_t done = 0;
+            while (done < size)
+            {
+#ifdef _WIN32
+                int count = _write(fd_, static_cast<const char *>(data) + done, static_cast<unsigned>(std::min<size_t>(size - done, 1 << 30)));
+#else
+                ssize_t count = ::write(fd_, static_cast<const char *>(data) + done, size - done);
+                if (count < 0 && errno == EINTR)
+                    continue;
+#endif
+                if (count <= 0)
+                    throw raster_exception_t("Cannot write to file descriptor");
+                done += static_cast<size_t>(count);
+            }
+        }
+    private:
+        int fd_;
+    };
+
+    ///
+    /// @brief Geometry and sample format of a raster
+    ///
+    struct raster_t
+    {
+        size_t width;
+        size_t height;
+        int    channels;
+        int    maxval; ///< 255 or 65535
+    };
+
+    ///
+    /// @brief Reads a PPM (P6) or PAM (P7) header, the source is left at the first sample
+    ///
+    inline raster_t read_pnm_header(raster_io_t &io)
+    {
+        // headers are read one byte at a time, so that no sample is consumed
+        auto next = [&io](void) -> int
+        {
+            char c;
+            if (io.read(&c, 1) != 1)
+                throw raster_exception_t("Truncated header");
+            return static_cast<unsigned char>(c);
+        };
+        auto token = [&](void) -> std::string
+        {
+            int c = next();
+            for (;;)
+            {
+                if (c == '#')
+                    while (c != '\n')
+                        c = next();
+                else if (std::isspace(c))
+                    c = next();
+                else
+                    break;
+            }
+            std::string result;
+            for (; !std::isspace(c); c = next())
+                result += static_cast<char>(c);
+            return result;
+        };
+        auto number = [&](const std::string &text) -> size_t
+        {
+            if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos || text.size() > 9)
+                throw raster_exception_t("Malformed header");
+            return std::stoul(text);
+        };
+        raster_t result = { 0, 0, 0, 0 };
+        std::string magic = token();
+        if (magic == "P6")
+        {
+            result.width = number(token());
+            result.height = number(token());
+            result.maxval = static_cast<int>(number(token())); // a single whitespace precedes the samples
+            result.channels = 3;
+        }
+        else if (magic == "P7")
+        {
+            for (std::string key = token(); key != "ENDHDR"; key = token())
+                if (key == "WIDTH")
+                    result.width = number(token());
+                else if (key == "HEIGHT")
+                    result.height = number(token());
+                else if (key == "DEPTH")
+                    result.channels = static_cast<int>(number(token()));
+                else if (key == "MAXVAL")
+                    result.maxval = static_cast<int>(number(token()));
+                else if (key == "TUPLTYPE")
+                    token();
+                else
+                    throw raster_exception_t("Malformed header");
+        }
+        else
+            throw raster_exception_t("Not a PPM or PAM file");
+        if (result.maxval != 255 && result.maxval != 65535)
+            throw raster_exception_t("Only 8 and 16 bit samples are supported");
+        if (result.channels <= 0)
+            throw raster_exception_t("Malformed header");
+        return result;
+    }
+
+    ///
+    /// @brief Writes a PPM header for 3 channels, a PAM one otherwise
+    ///
+    inline void write_pnm_header(raster_io_t &io, const raster_t &raster)
+    {
+        std::ostringstream ost;
+        if (raster.channels == 3)
+            ost << "P6\n" << raster.width << " " << raster.height << "\n" << raster.maxval << "\n";
+        else
+        {
+            ost << "P7\nWIDTH " << raster.width << "\nHEIGHT " << raster.height << "\nDEPTH " << raster.channels
+                << "\nMAXVAL " << raster.maxval << "\n";
+            if (raster.channels == 1)
+                ost << "TUPLTYPE GRAYSCALE\n";
+            else if (raster.channels == 4)
+                ost << "TUPLTYPE CMYK\n";
+            ost << "ENDHDR\n";
+        }
+        std::string header = ost.str();
+        io.write(header.data(), header.size());
+    }
+
+    const size_t stream_chunk_lines = 64; ///< default number of lines per chunk
+
+    ///
+    /// @class stream_transform_t
+    /// @brief Transforms rasters of X pixels into rasters of Y pixels a chunk at a time.
+    ///        X and Y must be made of channel_traits_t channels without padding.
+    ///        Chunks are transformed on pool when one is given.
+    ///
+    template <class Y, class X>
+    class stream_transform_t
+    {
+    public:
+        stream_transform_t(const function_t<Y, X> &f, size_t chunk_lines = stream_chunk_lines, worker_pool_t *pool = nullptr) :
+            f_(f), chunk_lines_(std::max<size_t>(chunk_lines, 1)), pool_(pool)
+        {}
+        ///
+        /// @brief Raw interleaved pixels in native byte order, no header
+        ///
+        void raw(raster_io_t &in, raster_io_t &out, size_t width, size_t height) const
+        {
+            run(in, out, width, height, false);
+        }
+        ///
+        /// @brief PPM or PAM in, PPM (3 channels) or PAM out, the sample size
+        ///        of the file must match the one of X
+        ///
+        void pnm(raster_io_t &in, raster_io_t &out) const
+        {
+            typedef typename channel_traits_t<X>::scalar_type in_scalar_t;
+            typedef typename channel_traits_t<Y>::scalar_type out_scalar_t;
+            static_assert(sizeof(in_scalar_t) <= 2 && sizeof(out_scalar_t) <= 2, "8 or 16 bit channels only");
+            raster_t raster = read_pnm_header(in);
+            if (raster.channels != channel_traits_t<X>::channels || raster.maxval != (sizeof(in_scalar_t) == 1 ? 255 : 65535))
+                throw raster_exception_t("Raster does not match the input pixel type");
+            raster.channels = channel_traits_t<Y>::channels;
+            raster.maxval = (sizeof(out_scalar_t) == 1 ? 255 : 65535);
+            write_pnm_header(out, raster);
+            run(in, out, raster.width, raster.height, little_endian());
+        }
+        size_t chunk_lines(void) const { return chunk_lines_; }
+    private:
+        static_assert(sizeof(X) == channel_traits_t<X>::channels * sizeof(typename channel_traits_t<X>::scalar_type), "X is not packed");
+        static_assert(sizeof(Y) == channel_traits_t<Y>::channels * sizeof(typename channel_traits_t<Y>::scalar_type), "Y is not packed");
+        enum { slots = 3 }; // one chunk being read, one transformed, one written
+        static const size_t npos = static_cast<size_t>(-1);
+
+        struct chunk_t
+        {
+            std::vector<X> in;
+            std::vector<Y> out;
+            size_t         pixels;
+        };
+        // blocking queue of slot indexes, closing it wakes everybody
+        class slot_queue_t
+        {
+        public:
+            slot_queue_t(void) : closed_(false) {}
+            void push(size_t slot)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    slots_.push_back(slot);
+                }
+                ready_.notify_one();
+            }
+            size_t pop(void) // npos when closed
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [this]() { return closed_ || !slots_.empty(); });
+                if (closed_)
+                    return npos;
+                size_t slot = slots_.front();
+                slots_.pop_front();
+                return slot;
+            }
+            void close(void)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    closed_ = true;
+                }
+                ready_.notify_all();
+            }
+        private:
+            std::mutex              mutex_;
+            std::condition_variable ready_;
+            std::deque<size_t>      slots_;
+            bool                    closed_;
+        };
+        struct pipeline_t
+        {
+            chunk_t            chunks[slots];
+            slot_queue_t       free;
+            slot_queue_t       read;
+            slot_queue_t       transformed;
+            std::mutex         mutex;
+            std::exception_ptr error;
+            void fail(void)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error)
+                        error = std::current_exception();
+                }
+                free.close();
+                read.close();
+                transformed.close();
+            }
+        };
+
+        static bool little_endian(void)
+        {
+            const std::uint16_t one = 1;
+            return *reinterpret_cast<const unsigned char *>(&one) == 1;
+        }
+        template <class P>
+        static void swap_bytes(P *pixels, size_t count)
+        {
+            typedef typename channel_traits_t<P>::scalar_type scalar_t;
+            if (sizeof(scalar_t) != 2)
+                return;
+            unsigned char *bytes = reinterpret_cast<unsigned char *>(pixels);
+            for (size_t i = 0; i < count * sizeof(P); i += 2)
+                std::swap(bytes[i], bytes[i + 1]);
+        }
+        void transform(chunk_t &chunk) const
+        {
+            if (pool_ == nullptr)
+            {
+                f_.eval_n(chunk.in.data(), chunk.out.data(), chunk.pixels);
+                return;
+            }
+            size_t tasks = std::min(pool_->size(), (chunk.pixels + span_block_size - 1) / span_block_size);
+            pool_->run(tasks, [&](size_t task)
+            {
+                size_t first = task * chunk.pixels / tasks;
+                size_t last = (task + 1) * chunk.pixels / tasks;
+                f_.eval_n(chunk.in.data() + first, chunk.out.data() + first, last - first);
+            });
+        }
+        void run(raster_io_t &in, raster_io_t &out, size_t width, size_t height, bool swap) const
+        {
+            if (width == 0 || height == 0)
+                return;
+            size_t chunk_pixels = std::min(chunk_lines_, height) * width;
+            pipeline_t pipeline;
+            for (size_t s = 0; s < slots; s++)
+            {
+                pipeline.chunks[s].in.resize(chunk_pixels);
+                pipeline.chunks[s].out.resize(chunk_pixels);
+                pipeline.free.push(s);
+            }
+            size_t total = width * height;
+            std::thread reader([&]()
+            {
+                try
+                {
+                    for (size_t done = 0; done < total; )
+                    {
+                        size_t slot = pipeline.free.pop();
+                        if (slot == npos)
+                            return;
+                        chunk_t &chunk = pipeline.chunks[slot];
+                        chunk.pixels = std::min(chunk_pixels, total - done);
+                        size_t bytes = chunk.pixels * sizeof(X);
+                        if (in.read(chunk.in.data(), bytes) != bytes)
+                            throw raster_exception_t("Unexpected end of raster data");
+                        if (swap)
+                            swap_bytes(chunk.in.data(), chunk.pixels);
+                        done += chunk.pixels;
+                        pipeline.read.push(slot);
+                    }
+                }
+                catch (...)
+                {
+                    pipeline.fail();
+                }
+            });
+            std::thread writer([&]()
+            {
+                try
+                {
+                    for (size_t done = 0; done < total; )
+                    {
+                        size_t slot = pipeline.transformed.pop();
+                        if (slot == npos)
+                            return;
+                        chunk_t &chunk = pipeline.chunks[slot];
+                        if (swap)
+                            swap_bytes(chunk.out.data(), chunk.pixels);
+                        out.write(chunk.out.data(), chunk.pixels * sizeof(Y));
+                        done += chunk.pixels;
+                        pipeline.free.push(slot);
+                    }
+                }
+                catch (...)
+                {
+                    pipeline.fail();
+                }
+            });
+            try
+            {
+                for (size_t done = 0; done < total; )
+                {
+                    size_t slot = pipeline.read.pop();
+                    if (slot == npos)
+                        break;
+                    transform(pipeline.chunks[slot]);
+                    done += pipeline.chunks[slot].pixels;
+                    pipeline.transformed.push(slot);
+                }
+            }
+            catch (...)
+            {
+                pipeline.fail();
+            }
+            reader.join();
+            writer.join();
+            if (pipeline.error)
+                std::rethrow_exception(pipeline.error);
+        }
+        function_t<Y, X> f_;
+        size_t           chunk_lines_;
+        worker_pool_t   *pool_;
+    };
+}
+#endif
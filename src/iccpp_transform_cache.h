@@ -0,0 +1,173 @@
+#ifndef iccpp_transform_cache_H
+#define iccpp_transform_cache_H
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <typeindex>
+
+#include "iccpp_profile.h"
+
+/**
+    @file
+    @brief A registry of compiled transforms between pairs of profiles
+*/
+namespace iccpp
+{
+    const size_t transform_cache_capacity = 64; ///< default number of transforms in transform_cache_t
+
+    ///
+    /// @class transform_cache_t
+    /// @brief Thread safe registry of transforms built by profile_t::transform.
+    ///
+    /// The key is made of the identity of both profiles, the intent, the pixel
+    /// types and the options, so a hit returns the shared compiled function_t
+    /// without walking the visitor chains again. Profiles are referenced weakly:
+    /// a transform whose profiles are gone is rebuilt. The least recently used
+    /// transforms are dropped past the capacity.
+    ///
+    class transform_cache_t
+    {
+    public:
+        struct statistics_t
+        {
+            size_t hits;
+            size_t misses;
+            size_t evictions;
+        };
+        explicit transform_cache_t(size_t capacity = transform_cache_capacity) : capacity_(capacity)
+        {
+            statistics_ = statistics_t();
+        }
+        transform_cache_t(const transform_cache_t &) = delete;
+        transform_cache_t &operator=(const transform_cache_t &) = delete;
+        static transform_cache_t &instance(void) ///< the process wide cache
+        {
+            static transform_cache_t the_cache;
+            return the_cache;
+        }
+        template <class Y, class X>
+        function_t<Y, X> get(const std::shared_ptr<profile_t> &output, const std::shared_ptr<profile_t> &input,
+                             rendering_intent_t intent = rendering_intent_t::relative_colorimetric,
+                             const transform_options_t &options = transform_options_t())
+        {
+            key_t key(output.get(), input.get(), intent, typeid(Y), typeid(X), options);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = index_.find(key);
+                if (it != index_.end())
+                {
+                    if (!it->second->output.expired() && !it->second->input.expired())
+                    {
+                        statistics_.hits++;
+                        entries_.splice(entries_.begin(), entries_, it->second);
+                        return function_t<Y, X>(std::static_pointer_cast<algo_t<Y, X>>(it->second->algo));
+                    }
+                    entries_.erase(it->second); // an address reused by another profile
+                    index_.erase(it);
+                }
+                statistics_.misses++;
+            }
+            // built out of the lock, the first one inserted wins
+            function_t<Y, X> result = profile_t::transform<Y, X>(*output, *input, intent, options);
+            std::shared_ptr<algo_t<Y, X>> algo = result.imp();
+            if (!algo)
+                return result;
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = index_.find(key);
+            if (it != index_.end())
+                return function_t<Y, X>(std::static_pointer_cast<algo_t<Y, X>>(it->second->algo));
+            entry_t entry = { key, output, input, algo };
+            entries_.push_front(entry);
+            index_[key] = entries_.begin();
+            evict();
+            return result;
+        }
+        statistics_t statistics(void) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return statistics_;
+        }
+        void capacity(size_t transforms)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            capacity_ = transforms;
+            evict();
+        }
+        size_t capacity(void) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return capacity_;
+        }
+        size_t size(void) const ///< number of cached transforms
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return entries_.size();
+        }
+        void clear(void)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_.clear();
+            index_.clear();
+        }
+    private:
+        struct key_t
+        {
+            key_t(const profile_t *o, const profile_t *i, rendering_intent_t r,
+                  std::type_index y, std::type_index x, const transform_options_t &options) :
+                output(o), input(i), intent(r), range(y), domain(x), optimize(options.optimize),
+                precompute(options.precompute), fixed_point(options.fixed_point), max_error(options.max_error)
+            {}
+            bool operator<(const key_t &rhs) const
+            {
+                return std::tie(output, input, intent, range, domain, optimize, precompute, fixed_point, max_error) <
+                       std::tie(rhs.output, rhs.input, rhs.intent, rhs.range, rhs.domain, 
+                                rhs.optimize, rhs.precompute, rhs.fixed_point, rhs.max_error);
+            }
+            const profile_t    *output;
+            const profile_t    *input;
+            rendering_intent_t  intent;
+            std::type_index     range;
+            std::type_index     domain;
+            bool                optimize;
+            bool                precompute;
+            bool                fixed_point;
+            double              max_error;
+        };
+        struct entry_t
+        {
+            key_t                           key;
+            std::weak_ptr<profile_t>        output;
+            std::weak_ptr<profile_t>        input;
+            std::shared_ptr<void>           algo; // an algo_t<Y, X>, types are part of the key
+        };
+        typedef std::list<entry_t> entries_t;
+
+        // lock must be held
+        void evict(void)
+        {
+            while (entries_.size() > capacity_)
+            {
+                index_.erase(entries_.back().key);
+                entries_.pop_back();
+                statistics_.evictions++;
+            }
+        }
+        mutable std::mutex                  mutex_;
+        size_t                              capacity_;
+        statistics_t                        statistics_;
+        entries_t                           entries_; // most recently used first
+        std::map<key_t, entries_t::iterator> index_;
+    };
+}
+#endif
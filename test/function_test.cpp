@@ -23,6 +23,8 @@
 #include <iostream>
 
 #include "iccpp_image.h"
+#include "iccpp_planar_image.h"
+#include "iccpp_extra_channels.h"
 #include "iccpp_function.h"
 #include "iccpp_profile.h"
 #include "iccpp_clut.h"
@@ -56,6 +58,24 @@ namespace iccpp
         unsigned char lut_[256];
     };
 
+    // 255 - value on every channel of 8 bit pixels
+    template <class P>
+    class invert_t : public algo_t<P, P>
+    {
+    public:
+        virtual P eval(const P &pixel) const override
+        {
+            P result;
+            for (int c = 0; c < channel_traits_t<P>::channels; c++)
+                channel_traits_t<P>::set(result, c, static_cast<unsigned char>(255 - channel_traits_t<P>::get(pixel, c)));
+            return result;
+        }
+        virtual invert_t<P> *clone(void) const override
+        {
+            return new invert_t<P>;
+        }
+    };
+
 }
 using namespace iccpp;
 
@@ -92,6 +112,124 @@ BOOST_AUTO_TEST_CASE(image_brighten)
     BOOST_CHECK(img[0][1].red == 128);
 }
 
+// parallel apply on a strided image must give the same result as the serial one
+BOOST_AUTO_TEST_CASE(image_parallel)
+{
+    using pixel_t = iccpp::rgba_t<unsigned char>;
+    const int stride = 41; // pixels per line, more than width
+    point_t size = { 37, 53 };
+    std::vector<pixel_t> data(stride * size.y), copy;
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        pixel_t pixel = { static_cast<unsigned char>(i), static_cast<unsigned char>(i * 3), static_cast<unsigned char>(i * 7), 0 };
+        data[i] = pixel;
+    }
+    copy = data;
+    image_t<pixel_t> img(data.data(), size, stride * sizeof(pixel_t));
+    image_t<pixel_t> ref(copy.data(), size, stride * sizeof(pixel_t));
+    function_t<pixel_t, pixel_t>  f(new brighten_t<pixel_t>(0.5));
+    worker_pool_t pool(4);
+    img.apply(f, pool);
+    ref.apply(f);
+    bool same = true;
+    for (size_t i = 0; i < data.size(); i++)
+        same = same && data[i].red == copy[i].red && data[i].green == copy[i].green && data[i].blue == copy[i].blue;
+    BOOST_CHECK(same);
+}
+
+// planar images, strided planes, to and from interleaved images
+BOOST_AUTO_TEST_CASE(image_planar)
+{
+    using pixel_t = iccpp::rgb_t<unsigned char>;
+    point_t size = { 300, 7 }; // more than a block per line
+    const int line_sizes[3] = { 300, 301, 317 };
+    std::vector<unsigned char> planes[3];
+    unsigned char *data[3];
+    for (int c = 0; c < 3; c++)
+    {
+        planes[c].resize(line_sizes[c] * size.y);
+        for (size_t i = 0; i < planes[c].size(); i++)
+            planes[c][i] = static_cast<unsigned char>(i * (c + 3));
+        data[c] = planes[c].data();
+    }
+    planar_image_t<pixel_t> planar(data, size, line_sizes);
+    image_t<pixel_t> interleaved(size);
+    for (int y = 0; y < size.y; y++)
+        planar.load(y, 0, interleaved[y], size.x);
+    BOOST_CHECK(interleaved[1][2].green == planes[1][301 + 2]);
+
+    function_t<pixel_t, pixel_t> f(new brighten_t<pixel_t>(0.5));
+    planar_image_t<pixel_t> copy(size);
+    copy.apply(f, interleaved);
+    image_t<pixel_t> back(size);
+    planar.apply_to(back, f);
+    worker_pool_t pool(4);
+    planar.apply(f, pool);
+    interleaved.apply(f);
+
+    bool same = true;
+    for (int y = 0; y < size.y; y++)
+        for (int x = 0; x < size.x; x++)
+        {
+            const pixel_t &ref = interleaved[y][x];
+            same = same && planar.plane(0, y)[x] == ref.red && planar.plane(1, y)[x] == ref.green && planar.plane(2, y)[x] == ref.blue;
+            same = same && copy.plane(0, y)[x] == ref.red && copy.plane(2, y)[x] == ref.blue;
+            same = same && back[y][x].green == ref.green;
+        }
+    BOOST_CHECK(same);
+    // padding is left untouched
+    BOOST_CHECK(planes[2][317 - 1] == static_cast<unsigned char>((317 - 1) * 5));
+}
+
+// alpha and spot channels go around the colour transform
+BOOST_AUTO_TEST_CASE(image_extra_channels)
+{
+    using rgba8_t = rgba_t<unsigned char>;
+    using rgb8_t = rgb_t<unsigned char>;
+    const size_t n = span_block_size + 44;
+    std::vector<rgba8_t> data(n), ref(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        rgba8_t pixel = { static_cast<unsigned char>(i), static_cast<unsigned char>(i * 3), static_cast<unsigned char>(i * 7),
+                          static_cast<unsigned char>(i * 11) };
+        data[i] = pixel;
+    }
+    function_t<rgba8_t, rgba8_t> wrapper(new brighten_t<rgba8_t>(0.5));
+    wrapper.eval_n(data.data(), ref.data(), n);
+    function_t<rgba8_t, rgba8_t> f = with_extra_channels<rgba8_t, rgba8_t>(function_t<rgb8_t, rgb8_t>(new brighten_t<rgb8_t>(0.5)));
+    f.eval_n(data.data(), data.data(), n); // in place
+    bool same = true;
+    for (size_t i = 0; i < n; i++)
+        same = same && data[i].red == ref[i].red && data[i].green == ref[i].green && data[i].blue == ref[i].blue && data[i].alpha == ref[i].alpha;
+    BOOST_CHECK(same);
+
+    // premultiplied colours are divided by alpha before the transform
+    function_t<rgba8_t, rgba8_t> pre = with_extra_channels<rgba8_t, rgba8_t>(function_t<rgb8_t, rgb8_t>(new brighten_t<rgb8_t>(0.5)),
+                                                                            alpha_mode_t::premultiplied);
+    rgba8_t half = { 64, 64, 0, 128 };
+    rgba8_t clear = { 10, 10, 10, 0 };
+    rgba8_t y = pre(half);
+    BOOST_CHECK(y.red == 91 && y.blue == 0 && y.alpha == 128); // 64 / 128 -> 128 -> 181 -> 181 * 128 / 255
+    y = pre(clear);
+    BOOST_CHECK(y.red == 0 && y.alpha == 0);
+
+    // channel types differ: alpha is rescaled
+    function_t<rgba_t<double>, rgba8_t> wide = with_extra_channels<rgba_t<double>, rgba8_t>(
+        function_t<rgb_t<double>, rgb8_t>(new color_conversion_t<rgb_t<double>, rgb8_t>));
+    rgba_t<double> w = wide(half);
+    BOOST_CHECK(fabs(w.alpha - 128 / 255.0) < 1e-12 && fabs(w.red - 64 / 255.0) < 1e-12);
+
+    // CMYK and two spots
+    using cmyk_t = vector_t<unsigned char, 4>;
+    using cmyk2_t = vector_t<unsigned char, 6>;
+    function_t<cmyk2_t, cmyk2_t> g = with_extra_channels<cmyk2_t, cmyk2_t>(function_t<cmyk_t, cmyk_t>(new invert_t<cmyk_t>));
+    cmyk2_t x;
+    for (int c = 0; c < 6; c++)
+        x[c] = static_cast<unsigned char>(10 * c);
+    cmyk2_t z = g(x);
+    BOOST_CHECK(z[0] == 255 && z[3] == 225 && z[4] == 40 && z[5] == 50);
+}
+
 //b test on xyz <--> lab conversions
 
 BOOST_AUTO_TEST_CASE(color_conversions)
@@ -112,6 +250,62 @@ BOOST_AUTO_TEST_CASE(color_conversions)
 
 }
 
+// fast Lab conversions against the formulas based on pow
+BOOST_AUTO_TEST_CASE(lab_conversions_accuracy)
+{
+    const double thrs = 0.008856;
+    const xyz_t white = xyz_t::D50();
+    xyz2lab_t xyz2lab(white);
+    lab2xyz_t lab2xyz(white);
+    auto f = [&](double t) { return t > thrs ? pow(t, 1 / 3.0) : 7.787 * t + 16.0 / 116; };
+    double err_lab = 0.0;
+    double err_xyz = 0.0;
+    for (int i = 0; i <= 24; i++)
+    for (int j = 0; j <= 24; j++)
+    for (int k = 0; k <= 24; k++)
+    {
+        xyz_t xyz = { i * 0.05, j * 0.05, k * 0.05 };
+        double t = xyz.y / white.y;
+        lab_t ref = { t > thrs ? 116 * pow(t, 1 / 3.0) - 16 : 903.3 * t,
+                      500 * (f(xyz.x / white.x) - f(t)),
+                      200 * (f(t) - f(xyz.z / white.z)) };
+        lab_t lab = xyz2lab.eval(xyz);
+        err_lab = std::max(err_lab, fabs(lab.L - ref.L) + fabs(lab.a - ref.a) + fabs(lab.b - ref.b));
+        double P = (ref.L + 16.0) / 116;
+        xyz_t back = lab2xyz.eval(ref);
+        err_xyz = std::max(err_xyz, fabs(back.x - white.x * pow(P + ref.a / 500, 3)) +
+                                    fabs(back.y - white.y * pow(P, 3)) +
+                                    fabs(back.z - white.z * pow(P - ref.b / 200, 3)));
+    }
+    BOOST_CHECK(err_lab < 1e-11);
+    BOOST_CHECK(err_xyz < 1e-13);
+    double err_cbrt = 0.0;
+    for (double t = 1e-6; t < 1e6; t *= 1.01)
+        err_cbrt = std::max(err_cbrt, fabs(lab_cbrt(t) / pow(t, 1 / 3.0) - 1));
+    BOOST_CHECK(err_cbrt < 1e-15);
+}
+
+// span evaluation of a composite must give the same result of pointwise evaluation
+BOOST_AUTO_TEST_CASE(function_eval_n)
+{
+    function_t<lab_t, xyz_t>  xyz2lab(new xyz2lab_t(xyz_t::D50()));
+    function_t<xyz_t, rgb_t<double>>  rgb2xyz(new rgb2xyz_t);
+    function_t<lab_t, rgb_t<double>> f = xyz2lab * rgb2xyz;
+    const size_t n = span_block_size + 17; // more than one block
+    std::vector<rgb_t<double>> rgb(n);
+    std::vector<lab_t> lab(n);
+    for (size_t i = 0; i < n; i++)
+        rgb[i] = rgb_t<double>(i / double(n), 0.5, 1.0 - i / double(n));
+    f.eval_n(rgb.data(), lab.data(), n);
+    bool same = true;
+    for (size_t i = 0; i < n; i++)
+    {
+        lab_t ref = f(rgb[i]);
+        same = same && ref.L == lab[i].L && ref.a == lab[i].a && ref.b == lab[i].b;
+    }
+    BOOST_CHECK(same);
+}
+
 template <int N>
 bool check_permutations(void)
 {
@@ -135,6 +329,36 @@ bool check_permutations(void)
     return true;
 }
 
+// the sorting network on pseudo random data with ties
+template <int N>
+bool check_network(void)
+{
+    unsigned seed = 12345;
+    for (size_t round = 0; round < 2000; round++)
+    {
+        delta_item_t<double> deltas[N];
+        for (size_t i = 0; i < N; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            deltas[i].value = static_cast<double>((seed >> 16) % (round % 2 == 0 ? 1000 : 4)) / 1000.0;
+            deltas[i].offset = i;
+        }
+        delta_item_t<double> sorted[N];
+        std::copy(deltas, deltas + N, sorted);
+        permutation_t<N, true>::indexes(sorted);
+        bool seen[N] = {};
+        for (size_t j = 0; j < N; j++)
+        {
+            if (j + 1 < N && sorted[j].value < sorted[j + 1].value)
+                return false;
+            if (sorted[j].offset >= N || seen[sorted[j].offset] || deltas[sorted[j].offset].value != sorted[j].value)
+                return false;
+            seen[sorted[j].offset] = true;
+        }
+    }
+    return true;
+}
+
 // simple test on a component for n-dimensionl look-up table 
 BOOST_AUTO_TEST_CASE(icc_permutation)
 {
@@ -152,9 +376,17 @@ BOOST_AUTO_TEST_CASE(icc_permutation)
     BOOST_CHECK(check_permutations<3>());
     BOOST_CHECK(check_permutations<4>());
     BOOST_CHECK(check_permutations<5>());
+    BOOST_CHECK(check_network<2>());
+    BOOST_CHECK(check_network<6>());
+    BOOST_CHECK(check_network<7>());
+    BOOST_CHECK(check_network<8>());
+    BOOST_CHECK(check_network<11>());
+    BOOST_CHECK(check_network<15>());
 
     delta_item_t<double> deltas[3] = { { 0.2, 0 }, { 0.4, 1 }, { 0.1, 2 } };
     perm.signature(deltas);
+    // the permutation table is shared, not held by each table
+    BOOST_CHECK((sizeof(arrayn_t<double, 5>) < 1024));
 }
 
 
@@ -20,6 +20,7 @@
 #endif
 #include "iccpp_lut_funct.h"
 #include "iccpp_pixel_traits.h"
+#include "iccpp_converters.h"
 
 using namespace iccpp;
 
@@ -108,3 +109,415 @@ BOOST_AUTO_TEST_CASE(lut_multi)
     BOOST_CHECK(test_multi_double<12>(4));
 }
 
+
+// whole transform sampled into a single lookup table
+BOOST_AUTO_TEST_CASE(lut_precompute)
+{
+    size_t grid = lut_grid_size<vector_t<double, 3>>(1e-3);
+    BOOST_CHECK(grid == 13);
+    grid = lut_grid_size<vector_t<unsigned char, 3>>(1e-3);
+    BOOST_CHECK(255 % (grid - 1) == 0);
+    grid = lut_grid_size<vector_t<double, 15>>(1e-3);
+    BOOST_CHECK(grid == 2);
+
+    using pixel_t = rgb_t<double>;
+    function_t<rgb_t<double>, xyz_t> output(new xyz2rgb_t);
+    function_t<lab_t, rgb_t<double>> input = function_t<lab_t, xyz_t>(new xyz2lab_t) * function_t<xyz_t, rgb_t<double>>(new rgb2xyz_t);
+    function_t<pixel_t, pixel_t> f = transform_t::create<pixel_t, pixel_t>(output.get(), input.get());
+    const double max_error = 5e-3;
+    function_t<pixel_t, pixel_t> g = transform_t::create<pixel_t, pixel_t>(output.get(), input.get(),
+                                                                         transform_options_t(true, true, max_error));
+    bool baked = std::dynamic_pointer_cast<lut_t<pixel_t, pixel_t>>(g.imp()) != nullptr;
+    BOOST_CHECK(baked);
+    double err = 0.0;
+    for (size_t k = 0; k < 1000; k++)
+    {
+        pixel_t x((std::rand() % 256) / 255.0, (std::rand() % 256) / 255.0, (std::rand() % 256) / 255.0);
+        pixel_t y0 = f(x);
+        pixel_t y1 = g(x);
+        err = std::max(err, std::fabs(y0.red - y1.red) + std::fabs(y0.green - y1.green) + std::fabs(y0.blue - y1.blue));
+    }
+    BOOST_CHECK(err <= max_error);
+    BOOST_CHECK(lut_error(f, g) <= max_error);
+
+    // a budget out of reach of lut_max_nodes leaves the transform as is
+    function_t<pixel_t, pixel_t> h = transform_t::create<pixel_t, pixel_t>(output.get(), input.get(),
+                                                                         transform_options_t(true, true, 1e-7));
+    bool unbaked = std::dynamic_pointer_cast<lut_t<pixel_t, pixel_t>>(h.imp()) == nullptr;
+    BOOST_CHECK(unbaked);
+
+    // the error of a table is found from the corners of the cells alone
+    function_t<pixel_t, pixel_t> table = make_lut<pixel_t, pixel_t, interp_tetra_t>(f, 9);
+    double estimated = lut_error_at<pixel_t, pixel_t>(f, 9, lut_error_samples);
+    BOOST_CHECK(std::fabs(estimated - lut_error(f, table)) < 1e-9);
+    size_t built = 0;
+    function_t<pixel_t, pixel_t> within = make_lut_within(f, max_error, &built);
+    BOOST_CHECK(within && lut_grid_within(f, max_error) == built);
+
+    // 8 bit outputs are compared up to their rounding, so that the table is built
+    using pixel8_t = rgb_t<unsigned char>;
+    function_t<pixel8_t, pixel8_t> f8 = transform_t::create<pixel8_t, pixel8_t>(output.get(), input.get());
+    function_t<pixel8_t, pixel8_t> g8 = transform_t::create<pixel8_t, pixel8_t>(output.get(), input.get(),
+                                                                             transform_options_t(true, true));
+    bool baked8 = std::dynamic_pointer_cast<lut_t<pixel8_t, pixel8_t>>(g8.imp()) != nullptr;
+    BOOST_CHECK(baked8);
+    BOOST_CHECK(lut_error(f8, g8) <= 1e-3 + lut_rounding<pixel8_t>());
+    estimated = lut_error_at<pixel8_t, pixel8_t>(f8, 18, lut_error_samples);
+    BOOST_CHECK(estimated == lut_error(f8, make_lut<pixel8_t, pixel8_t, interp_tetra_t>(f8, 18)));
+}
+
+// span kernels must agree with the generic interpolation
+template <class S, int M, int N>
+class test_mix_t : public algo_t<vector_t<S, M>, vector_t<S, N>>
+{
+public:
+    virtual vector_t<S, M> eval(const vector_t<S, N> &x) const override
+    {
+        vector_t<S, M> result;
+        for (size_t i = 0; i < M; i++)
+            result[i] = static_cast<S>(x[i % N] * x[(i + 1) % N]);
+        return result;
+    }
+    virtual test_mix_t<S, M, N> *clone(void) const override
+    {
+        return new test_mix_t<S, M, N>;
+    }
+};
+
+template <class T, int M, int N>
+bool test_lut_kernel(size_t steps)
+{
+    using input_t = vector_t<T, N>;
+    using output_t = vector_t<T, M>;
+    function_t<output_t, input_t> seed(new test_mix_t<T, M, N>);
+    function_t<output_t, input_t> funct(make_lut<output_t, input_t, interp_tetra_t>(seed, steps));
+    const size_t n = 300;
+    std::vector<input_t> x(n);
+    std::vector<output_t> y(n);
+    for (size_t k = 0; k < n; k++)
+        for (size_t i = 0; i < N; i++)
+            x[k][i] = static_cast<T>(scalar_traits_t<T>::one() * (std::rand() % 237) / static_cast<T>(236));
+    x[0] = input_t(scalar_traits_t<T>::one()); // upper corner
+    funct.eval_n(x.data(), y.data(), n);
+    for (size_t k = 0; k < n; k++)
+    {
+        output_t d = funct(x[k]) - y[k];
+        if (d.module2() > 1e-20)
+            return false;
+    }
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(lut_kernels)
+{
+    BOOST_CHECK((test_lut_kernel<double, 3, 3>(17)));
+    BOOST_CHECK((test_lut_kernel<double, 4, 3>(9)));
+    // CMYK to Lab and CMYK to CMYK
+    BOOST_CHECK((test_lut_kernel<double, 3, 4>(9)));
+    BOOST_CHECK((test_lut_kernel<double, 4, 4>(17)));
+}
+
+// fixed point table against the floating point one with the same grid
+BOOST_AUTO_TEST_CASE(lut_fixed_point)
+{
+    using pixel_t = rgb_t<double>;
+    using pixel8_t = rgb_t<unsigned char>;
+    function_t<pixel_t, xyz_t> output(new xyz2rgb_t);
+    function_t<lab_t, pixel_t> input = function_t<lab_t, xyz_t>(new xyz2lab_t) * function_t<xyz_t, pixel_t>(new rgb2xyz_t);
+    function_t<pixel_t, pixel_t> f = transform_t::create<pixel_t, pixel_t>(output.get(), input.get());
+    const size_t grid = 17;
+    function_t<pixel_t, pixel_t> lut = make_lut<pixel_t, pixel_t, interp_tetra_t>(f, grid);
+    function_t<pixel8_t, pixel8_t> fixed = make_fixed_lut<pixel8_t, pixel8_t>(f, grid);
+    int err = 0;
+    for (size_t k = 0; k < 1000; k++)
+    {
+        pixel8_t x(std::rand() % 256, std::rand() % 256, std::rand() % 256);
+        pixel_t y = lut(pixel_t(x.red / 255.0, x.green / 255.0, x.blue / 255.0));
+        pixel8_t y8 = fixed(x);
+        err = std::max(err, std::abs(static_cast<int>(y.red * 255 + 0.5) - y8.red));
+        err = std::max(err, std::abs(static_cast<int>(y.green * 255 + 0.5) - y8.green));
+        err = std::max(err, std::abs(static_cast<int>(y.blue * 255 + 0.5) - y8.blue));
+    }
+    BOOST_CHECK(err <= 1);
+
+    // the span path finds the same tetrahedra as eval, for 8 and 16 bit inputs
+    using pixel16_t = rgb_t<unsigned short>;
+    function_t<pixel16_t, pixel16_t> fixed16 = make_fixed_lut<pixel16_t, pixel16_t>(f, grid);
+    std::vector<pixel8_t> x8(1000), y8(x8.size());
+    std::vector<pixel16_t> x16(x8.size()), y16(x8.size());
+    for (size_t k = 0; k < x8.size(); k++)
+    {
+        x8[k] = pixel8_t(std::rand() % 256, std::rand() % 256, k % 256);
+        x16[k] = pixel16_t(std::rand() % 65536, std::rand() % 65536, (k % 256) * 257);
+    }
+    fixed.eval_n(x8.data(), y8.data(), x8.size());
+    fixed16.eval_n(x16.data(), y16.data(), x16.size());
+    bool same = true;
+    for (size_t k = 0; k < x8.size(); k++)
+    {
+        pixel8_t e8 = fixed(x8[k]);
+        pixel16_t e16 = fixed16(x16[k]);
+        same = same && e8.red == y8[k].red && e8.green == y8[k].green && e8.blue == y8[k].blue;
+        same = same && e16.red == y16[k].red && e16.green == y16[k].green && e16.blue == y16[k].blue;
+    }
+    BOOST_CHECK(same);
+
+    function_t<pixel8_t, pixel8_t> g = transform_t::create<pixel8_t, pixel8_t>(output.get(), input.get(),
+                                                                             transform_options_t(false, false, 1e-3, true));
+    std::shared_ptr<fixed_lut_t<pixel8_t, pixel8_t>> compiled = std::dynamic_pointer_cast<fixed_lut_t<pixel8_t, pixel8_t>>(g.imp());
+    BOOST_CHECK(compiled);
+    // with the grid of the floating point table within the same error, up to the output rounding
+    function_t<pixel_t, pixel_t> real = transform_t::create<pixel_t, pixel_t>(output.get(), input.get(), transform_options_t(true));
+    size_t within = 0;
+    make_lut_within(real, 1e-3 + lut_rounding<pixel8_t>(), &within);
+    BOOST_CHECK(compiled && compiled->grid() == within);
+}
+
+// clones share the table until one of them is written
+BOOST_AUTO_TEST_CASE(lut_shared_table)
+{
+    using vector = vector_t<double, 4>;
+    size_t steps[] = { 5, 5, 5, 5 };
+    lut_t<vector, vector> lut(steps, vector(0.25));
+    for (size_t i = 0; i < lut.datasize(); i++)
+        lut[static_cast<int>(i)] = vector(static_cast<double>(i));
+    std::unique_ptr<lut_t<vector, vector>> copy(lut.clone());
+    BOOST_CHECK(copy->table().data() == lut.table().data());
+    (*copy)[0] = vector(1.0);
+    BOOST_CHECK(copy->table().data() != lut.table().data());
+    BOOST_CHECK(lut.table().data()[0][0] == 0.0);
+}
+
+namespace
+{
+    template <class L, class F>
+    void fill_table(L &lut, F f)
+    {
+        for (size_t i = 0; i < lut.datasize(); i++)
+            lut[static_cast<int>(i)] = f(i);
+    }
+    // largest difference between a fixed grid table and a lut_t holding the same data
+    template <int In, int Out, size_t G, class I>
+    double fixed_grid_error(void)
+    {
+        using input = vector_t<double, In>;
+        using output = vector_t<double, Out>;
+        size_t steps[In];
+        arithmetic_t<size_t, In>::assign(steps, G);
+        lut_t<output, input, I> lut(steps, input(1.0 / (G - 1)));
+        fixed_grid_lut_t<output, input, G, I> fixed;
+        BOOST_CHECK(fixed.datasize() == lut.datasize());
+        auto table = [](size_t i) 
+        {
+            output result;
+            for (int c = 0; c < Out; c++)
+                result[c] = static_cast<double>((i * (2 * c + 7)) % 23) / 23.0;
+            return result;
+        };
+        fill_table(lut, table);
+        fill_table(fixed, table);
+
+        std::vector<input> x;
+        for (size_t i = 0; i < 4000; i++)
+        {
+            input value;
+            for (int k = 0; k < In; k++)
+                value[k] = static_cast<double>((i * (k + 3) * 7919) % 1001) / 1000.0; // includes 0 and 1
+            x.push_back(value);
+        }
+        std::vector<output> y(x.size()), y_fixed(x.size());
+        lut.eval_n(x.data(), y.data(), x.size());
+        fixed.eval_n(x.data(), y_fixed.data(), x.size());
+        double error = 0.0;
+        for (size_t i = 0; i < x.size(); i++)
+        {
+            output single = fixed.eval(x[i]);
+            for (int c = 0; c < Out; c++)
+            {
+                error = std::max(error, std::fabs(y[i][c] - y_fixed[i][c]));
+                error = std::max(error, std::fabs(y[i][c] - single[c]));
+            }
+        }
+        return error;
+    }
+}
+
+// tables with the grid size as template parameter interpolate as lut_t does
+BOOST_AUTO_TEST_CASE(lut_fixed_grid)
+{
+    BOOST_CHECK((fixed_grid_error<3, 3, 17, interp_tetra_t>()) < 1e-12);
+    BOOST_CHECK((fixed_grid_error<3, 4, 33, interp_tetra_t>()) < 1e-12);
+    BOOST_CHECK((fixed_grid_error<3, 3, 17, interp_multi_t>()) < 1e-12);
+    BOOST_CHECK((fixed_grid_error<4, 3, 17, interp_tetra_t>()) < 1e-12);
+    BOOST_CHECK((fixed_grid_error<4, 3, 9, interp_multi_t>()) < 1e-12);
+
+    using vector = vector_t<double, 3>;
+    fixed_grid_lut_t<vector, vector, 17> lut;
+    fill_table(lut, [](size_t i) { return vector(static_cast<double>(i)); });
+    std::unique_ptr<fixed_grid_lut_t<vector, vector, 17>> copy(lut.clone());
+    BOOST_CHECK(copy->table().data() == lut.table().data());
+    BOOST_CHECK(std::fabs(lut.eval(vector(1.0))[0] - (17 * 17 * 17 - 1)) < 1e-9);
+}
+
+// gamma encoding, steep near 0
+class encode_t : public algo_t<vector_t<double, 3>, vector_t<double, 3>>
+{
+public:
+    using vector = vector_t<double, 3>;
+    virtual vector eval(const vector &x) const override
+    {
+        vector result;
+        for (int i = 0; i < 3; i++)
+            result[i] = std::pow(x[i], 1.0 / 2.2);
+        return result;
+    }
+    virtual encode_t *clone(void) const override
+    {
+        return new encode_t;
+    }
+};
+
+// largest difference of f and g, through eval and eval_n
+template <class F, class G>
+double lut_distance(const F &f, const G &g)
+{
+    using vector = vector_t<double, 3>;
+    std::vector<vector> x;
+    for (size_t i = 0; i <= 1000; i++)
+    {
+        vector value;
+        value[0] = i / 1000.0;
+        value[1] = std::fmod(i * 0.618034, 1.0);
+        value[2] = std::fmod(i * 0.414214, 1.0);
+        x.push_back(value);
+    }
+    std::vector<vector> y(x.size());
+    g.eval_n(x.data(), y.data(), x.size());
+    double result = 0.0;
+    for (size_t i = 0; i < x.size(); i++)
+    {
+        vector expected = f(x[i]);
+        result = std::max(result, std::sqrt((expected - y[i]).module2()));
+        result = std::max(result, std::sqrt((expected - g(x[i])).module2()));
+    }
+    return result;
+}
+
+// grids with per axis breakpoints
+BOOST_AUTO_TEST_CASE(lut_nonuniform)
+{
+    using vector = vector_t<double, 3>;
+    // the index table leads to the cell a linear search finds
+    grid_axis_t axis = density_grid_axis([](double t) { return 1.0 / (0.01 + t); }, 12);
+    bool found = true;
+    for (size_t i = 0; i <= 1000; i++)
+    {
+        double x = i / 1000.0, fraction;
+        size_t cell = axis.cell(x, fraction);
+        size_t expected = 0;
+        while (expected + 2 < axis.size() && x >= axis[expected + 1])
+            expected++;
+        found = found && cell == expected && fraction >= 0.0 && fraction <= 1.0;
+    }
+    BOOST_CHECK(found);
+    BOOST_CHECK(axis[0] == 0.0 && axis[axis.size() - 1] == 1.0 && axis[1] < 0.01);
+
+    // constant density is the uniform grid
+    std::vector<grid_axis_t> uniform(3, density_grid_axis([](double) { return 1.0; }, 9));
+    BOOST_CHECK(std::fabs(uniform[0][4] - 0.5) < 1e-12);
+    function_t<vector, vector> seed(new test_mix_t<double, 3, 3>);
+    BOOST_CHECK(lut_distance(make_lut<vector, vector, interp_tetra_t>(seed, 9),
+                             make_lut<vector, vector, interp_tetra_t>(seed, uniform)) < 1e-9);
+    BOOST_CHECK(lut_distance(make_lut<vector, vector, interp_multi_t>(seed, 9),
+                             make_lut<vector, vector, interp_multi_t>(seed, uniform)) < 1e-9);
+
+    // nodes following the curvature do better than the same number of uniform ones
+    function_t<vector, vector> encode(new encode_t);
+    std::vector<grid_axis_t> axes = curvature_grid_axes(encode, 9);
+    BOOST_CHECK(axes.size() == 3 && axes[0].size() == 9 && axes[0][1] < 0.125);
+    double uniform_error = lut_distance(encode, make_lut<vector, vector, interp_tetra_t>(encode, 9));
+    double curvature_error = lut_distance(encode, make_lut<vector, vector, interp_tetra_t>(encode, axes));
+    BOOST_CHECK(curvature_error < 0.5 * uniform_error);
+
+    function_t<vector, vector> lut = make_lut<vector, vector, interp_tetra_t>(encode, axes);
+    std::unique_ptr<algo_t<vector, vector>> copy(lut.imp()->clone());
+    BOOST_CHECK(lut_distance(lut, function_t<vector, vector>(copy.release())) < 1e-12);
+
+    // one axis for each input, at least 2 nodes on each
+    bool thrown = false;
+    try
+    {
+        nonuniform_lut_t<vector, vector> wrong(std::vector<grid_axis_t>(2, axes[0]));
+    }
+    catch (const std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    BOOST_CHECK(thrown);
+    thrown = false;
+    try
+    {
+        density_grid_axis([](double) { return 1.0; }, 1);
+    }
+    catch (const std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    BOOST_CHECK(thrown);
+
+    // breakpoints: at least 2, strictly increasing, from 0 to 1
+    const std::vector<double> wrong_breakpoints[] = { {}, { 0.0 }, { 0.0, 0.5, 0.5, 1.0 }, { 0.0, 0.6, 0.4, 1.0 },
+                                                      { 0.1, 0.5, 1.0 }, { 0.0, 0.5, 0.9 } };
+    for (const std::vector<double> &breakpoints : wrong_breakpoints)
+    {
+        thrown = false;
+        try
+        {
+            grid_axis_t wrong(breakpoints);
+        }
+        catch (const std::invalid_argument &)
+        {
+            thrown = true;
+        }
+        BOOST_CHECK(thrown);
+    }
+    grid_axis_t two(std::vector<double>{ 0.0, 1.0 });
+    BOOST_CHECK(two.size() == 2);
+}
+
+// nodes sampled in blocks on several threads are the ones of a serial loop
+BOOST_AUTO_TEST_CASE(lut_parallel_sampling)
+{
+    using input = vector_t<double, 4>;
+    using output = vector_t<double, 3>;
+    using table_t = lut_t<output, input>;
+    function_t<output, input> seed(new test_mix_t<double, 3, 4>);
+    size_t steps[] = { 9, 7, 5, 11 };
+    input step;
+    for (int k = 0; k < 4; k++)
+        step[k] = 1.0 / (steps[k] - 1);
+    worker_pool_t serial(1), pool(4);
+    function_t<output, input> f = make_lut<output, input, interp_tetra_t>(seed, steps, step, serial);
+    function_t<output, input> g = make_lut<output, input, interp_tetra_t>(seed, steps, step, pool);
+    std::shared_ptr<table_t> lhs = std::dynamic_pointer_cast<table_t>(f.imp());
+    std::shared_ptr<table_t> rhs = std::dynamic_pointer_cast<table_t>(g.imp());
+    BOOST_CHECK(lhs && rhs);
+    if (!lhs || !rhs)
+        return;
+    bool same = true;
+    for (size_t i = 0; i < lhs->datasize(); i++)
+    {
+        size_t digits[4];
+        for (size_t k = 0, t = i; k < 4; k++)
+        {
+            digits[k] = t % steps[k];
+            t /= steps[k];
+        }
+        output expected = seed(lut_input_traits_t<input>::build(step, digits));
+        const output &l = lhs->table().data()[i];
+        const output &r = rhs->table().data()[i];
+        for (int c = 0; c < 3; c++)
+            same = same && l[c] == expected[c] && r[c] == expected[c];
+    }
+    BOOST_CHECK(same);
+}
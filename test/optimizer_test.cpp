@@ -0,0 +1,226 @@
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+
+/**	@file: optimizer_test.cpp
+
+    @brief Test of the transform chain optimizer
+*/
+
+#ifdef HAVE_BOOST_TEST
+#include <boost/test/auto_unit_test.hpp>
+#else
+#include "test_registrar.h"
+#endif
+#include "iccpp_color_spaces.h"
+#include "iccpp_curve.h"
+#include "iccpp_optimizer.h"
+#include "iccpp_instrument.h"
+#include <sstream>
+
+using namespace iccpp;
+
+namespace
+{
+    icc_curve_t<3> *make_curve(double gamma)
+    {
+        algo_t<double, double> *components[3] = { new icc_gamma_curve_t(gamma),
+                                                  new icc_curve_parametric_t(gamma, 0.9, 0.1),
+                                                  new identity_t<double> };
+        return new icc_curve_t<3>(components);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(optimizer_fusion)
+{
+    using vector3_t = vector_t<double, 3>;
+    const double linear[3][3] = { { 0.5, 0.2, 0.1 }, { 0.1, 0.6, 0.2 }, { 0.0, 0.1, 0.7 } };
+    const double affine[3][4] = { { 0.9, 0.0, 0.1, 0.01 }, { 0.0, 0.8, 0.1, 0.02 }, { 0.1, 0.1, 0.7, 0.0 } };
+    function_t<vector3_t, vector3_t> curves = function_t<vector3_t, vector3_t>(make_curve(1.8)) *
+                                              function_t<vector3_t, vector3_t>(make_curve(2.2));
+    function_t<vector3_t, vector3_t> matrices = function_t<vector3_t, vector3_t>(new icc_matrix_linear_t<3, 3>(linear)) *
+                                                function_t<vector3_t, vector3_t>(new icc_matrix_affine_t<3, 3>(affine));
+    function_t<vector3_t, vector3_t> roundtrip = function_t<vector3_t, xyz_t>(new color_conversion_t<vector3_t, xyz_t>) *
+                                                 function_t<xyz_t, vector3_t>(new color_conversion_t<xyz_t, vector3_t>);
+    function_t<xyz_t, vector3_t> f = function_t<xyz_t, vector3_t>(new color_conversion_t<xyz_t, vector3_t>) *
+                                     (roundtrip * (matrices * (function_t<vector3_t, vector3_t>(new identity_t<vector3_t>) * curves)));
+    function_t<xyz_t, vector3_t> g = optimize(f);
+    std::shared_ptr<chain_t<xyz_t, vector3_t>> chain = std::dynamic_pointer_cast<chain_t<xyz_t, vector3_t>>(g.imp());
+    BOOST_CHECK(chain);
+    // curve, matrix, conversion
+    BOOST_CHECK(chain && chain->stages() == 3);
+
+    double err = 0.0;
+    for (int i = 0; i < 1000; i++)
+    {
+        vector3_t x;
+        for (int j = 0; j < 3; j++)
+            x[j] = (std::rand() % 1001) / 1000.0;
+        xyz_t y0 = f(x);
+        xyz_t y1 = g(x);
+        err = std::max(err, std::fabs(y0.x - y1.x) + std::fabs(y0.y - y1.y) + std::fabs(y0.z - y1.z));
+    }
+    BOOST_CHECK(err < 1e-4);
+}
+
+// the Lab encoding round trip is dropped, results change only by rounding
+BOOST_AUTO_TEST_CASE(optimizer_inverse_conversions)
+{
+    using vector3_t = vector_t<double, 3>;
+    function_t<xyz_t, vector3_t> f = function_t<xyz_t, lab_t>(new color_conversion_t<xyz_t, lab_t>) *
+                                     (function_t<lab_t, vector3_t>(new color_conversion_t<lab_t, vector3_t>) *
+                                      (function_t<vector3_t, lab_t>(new color_conversion_t<vector3_t, lab_t>) *
+                                       function_t<lab_t, vector3_t>(new color_conversion_t<lab_t, vector3_t>)));
+    function_t<xyz_t, vector3_t> g = optimize(f);
+    std::shared_ptr<chain_t<xyz_t, vector3_t>> chain = std::dynamic_pointer_cast<chain_t<xyz_t, vector3_t>>(g.imp());
+    BOOST_CHECK(chain && chain->stages() == 2);
+    double err = 0.0;
+    for (int i = 0; i <= 1000; i++)
+    {
+        vector3_t x;
+        for (int j = 0; j < 3; j++)
+            x[j] = ((i * (j + 3)) % 1001) / 1000.0;
+        xyz_t y0 = f(x);
+        xyz_t y1 = g(x);
+        err = std::max(err, std::fabs(y0.x - y1.x) + std::fabs(y0.y - y1.y) + std::fabs(y0.z - y1.z));
+    }
+    BOOST_CHECK(err < 1e-12);
+}
+
+BOOST_AUTO_TEST_CASE(optimizer_fused_curves)
+{
+    std::unique_ptr<icc_curve_t<3>> lhs(make_curve(1.8));
+    std::unique_ptr<icc_curve_t<3>> rhs(make_curve(2.2));
+    std::unique_ptr<algo_base_t> fused(lhs->fuse(*rhs));
+    icc_curve_t<3> *curve = dynamic_cast<icc_curve_t<3> *>(fused.get());
+    BOOST_CHECK(curve);
+    double err = 0.0;
+    for (int i = 0; curve && i <= 10000; i++)
+    {
+        vector_t<double, 3> x(i / 10000.0);
+        vector_t<double, 3> y0 = lhs->eval(rhs->eval(x));
+        vector_t<double, 3> y1 = curve->eval(x);
+        for (int c = 0; c < 3; c++)
+            err = std::max(err, std::fabs(y0[c] - y1[c]));
+    }
+    BOOST_CHECK(err <= fused_curve_tolerance);
+
+    // the slope of gamma 1/2.2 at 0 is infinite: the curves are not fused
+    std::unique_ptr<icc_curve_t<3>> steep(make_curve(1 / 2.2));
+    algo_t<double, double> *identities[3] = { new identity_t<double>, new identity_t<double>, new identity_t<double> };
+    icc_curve_t<3> identity(identities);
+    BOOST_CHECK(!std::unique_ptr<algo_base_t>(steep->fuse(identity)));
+}
+
+BOOST_AUTO_TEST_CASE(optimizer_instrument)
+{
+    using vector3_t = vector_t<double, 3>;
+    const double linear[3][3] = { { 0.5, 0.2, 0.1 }, { 0.1, 0.6, 0.2 }, { 0.0, 0.1, 0.7 } };
+    function_t<xyz_t, vector3_t> f = function_t<xyz_t, vector3_t>(new color_conversion_t<xyz_t, vector3_t>) *
+                                     (function_t<vector3_t, vector3_t>(new icc_matrix_linear_t<3, 3>(linear)) *
+                                      function_t<vector3_t, vector3_t>(make_curve(2.2)));
+    function_t<xyz_t, vector3_t> g = instrument(f, true);
+    function_t<xyz_t, vector3_t> h = instrument(optimize(f));
+    // probes do not change results
+    std::vector<vector3_t> x(100);
+    for (size_t i = 0; i < x.size(); i++)
+        for (int j = 0; j < 3; j++)
+            x[i][j] = (i + j) / 102.0;
+    std::vector<xyz_t> y0(x.size()), y1(x.size()), y3(x.size());
+    f.eval_n(x.data(), y0.data(), x.size());
+    g.eval_n(x.data(), y1.data(), x.size());
+    xyz_t y2 = g(x[0]);
+    h.eval_n(x.data(), y3.data(), x.size());
+    BOOST_CHECK(y0[0].x == y2.x && y0[0].y == y2.y && y0[0].z == y2.z);
+    BOOST_CHECK(y0.back().x == y1.back().x && y0.back().z == y1.back().z);
+    BOOST_CHECK(std::fabs(y0.back().x - y3.back().x) < 1e-4); // optimized curves are baked
+
+    std::shared_ptr<stage_probe_t<xyz_t, vector3_t>> probe = std::dynamic_pointer_cast<stage_probe_t<xyz_t, vector3_t>>(g.imp());
+    BOOST_CHECK(probe);
+    if (!probe)
+        return;
+    stage_report_t report = probe->report();
+    BOOST_CHECK(report.calls == 2);
+    BOOST_CHECK(report.values == x.size() + 1);
+    BOOST_CHECK(report.input_min.size() == 3 && report.output_max.size() == 3);
+    BOOST_CHECK(report.input_min[0] == 0.0 && report.input_max[2] == (x.size() + 1) / 102.0);
+
+    // every leaf of the tree is wrapped
+    algo_base_t::stage_list_t stages;
+    probe->inner()->children(stages);
+    BOOST_CHECK(stages.size() == 2);
+    for (const std::shared_ptr<algo_base_t> &stage : stages)
+    {
+        const stage_probe_base_t *p = dynamic_cast<const stage_probe_base_t *>(stage.get());
+        BOOST_CHECK(p && p->report().values == x.size() + 1);
+    }
+
+    std::ostringstream ost;
+    dump_stages(ost, g);
+    std::string dump = ost.str();
+    BOOST_CHECK(dump.find("color_conversion_t") != std::string::npos);
+    BOOST_CHECK(dump.find("icc_matrix_linear_t") != std::string::npos);
+    BOOST_CHECK(dump.find("\n    iccpp::icc_curve_t") != std::string::npos); // two levels down
+    std::ostringstream chain;
+    dump_stages(chain, h);
+    BOOST_CHECK(chain.str().find("chain_t") != std::string::npos);
+    BOOST_CHECK(chain.str().find(" in [") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(optimizer_baked_curves)
+{
+    using vector3_t = vector_t<double, 3>;
+    icc_gamma_curve_t gamma(2.2);
+    std::unique_ptr<icc_curve_baked_t> baked(bake_curve(gamma));
+    BOOST_CHECK(baked && baked->size() == baked_curve_knots);
+    double err = 0.0;
+    for (int i = 0; i <= 1000; i++)
+        err = std::max(err, std::fabs(baked->eval(i / 1000.0) - gamma.eval(i / 1000.0)));
+    BOOST_CHECK(err < baked_curve_tolerance);
+    BOOST_CHECK(baked->eval(-1.0) == 0.0 && baked->eval(2.0) == 1.0);
+
+    // exact on the codes of 8 bit inputs
+    std::unique_ptr<icc_curve_baked_t> table(icc_curve_baked_t::sample(gamma, 256));
+    err = 0.0;
+    for (int i = 0; i < 256; i++)
+        err = std::max(err, std::fabs(table->eval(i / 255.0) - gamma.eval(i / 255.0)));
+    BOOST_CHECK(err < 1e-12);
+
+    // the slope at 0 is infinite: no table is accurate enough
+    icc_gamma_curve_t steep(1 / 2.4);
+    BOOST_CHECK(!std::unique_ptr<icc_curve_baked_t>(bake_curve(steep)));
+
+    // interpolated curves keep their knots
+    std::vector<double> knots = { 0.0, 0.1, 0.5, 1.0 };
+    icc_curve_interpolated_t interpolated(knots);
+    std::unique_ptr<icc_curve_baked_t> same(bake_curve(interpolated));
+    BOOST_CHECK(same && same->size() == knots.size());
+    BOOST_CHECK(same && std::fabs(same->eval(0.5) - interpolated.eval(0.5)) < 1e-15);
+
+    std::unique_ptr<icc_curve_t<3>> curve(make_curve(2.2));
+    std::unique_ptr<algo_base_t> once(curve->bake());
+    BOOST_CHECK(once);
+    BOOST_CHECK(!std::unique_ptr<algo_base_t>(dynamic_cast<icc_curve_t<3> &>(*once).bake()));
+    algo_t<double, double> *identities[3] = { new identity_t<double>, new identity_t<double>, new identity_t<double> };
+    BOOST_CHECK(!std::unique_ptr<algo_base_t>(icc_curve_t<3>(identities).bake()));
+
+    // optimized transforms use the baked curves
+    function_t<vector3_t, vector3_t> f(make_curve(2.2));
+    function_t<vector3_t, vector3_t> g = optimize(f);
+    err = 0.0;
+    for (int i = 0; i <= 1000; i++)
+    {
+        vector3_t x(i / 1000.0);
+        vector3_t y0 = f(x);
+        vector3_t y1 = g(x);
+        for (int c = 0; c < 3; c++)
+            err = std::max(err, std::fabs(y0[c] - y1[c]));
+    }
+    BOOST_CHECK(err < baked_curve_tolerance);
+}
@@ -8,6 +8,13 @@
 // http://www.boost.org/LICENSE_1_0.txt)
 //
 #include "iccpp_profile.h"
+#include "iccpp_profile_cache.h"
+#include "iccpp_transform_cache.h"
+#include "iccpp_instrument.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
 
 /**	@file: profiles_test.cpp
 
@@ -107,3 +114,362 @@ BOOST_AUTO_TEST_CASE(icc_cmyk)
     function_t<cmyku_t, lab_t> gu = handler->pcs2device<cmyku_t, lab_t>();
     BOOST_CHECK(gu);
 }
+
+namespace
+{
+    struct profile_writer_t
+    {
+        std::vector<unsigned char> bytes;
+        void u8(unsigned value) { bytes.push_back(static_cast<unsigned char>(value)); }
+        void u16(unsigned value) { u8(value >> 8); u8(value & 0xff); }
+        void u32(unsigned value) { u16(value >> 16); u16(value & 0xffff); }
+        void at32(size_t pos, unsigned value)
+        {
+            for (int i = 0; i < 4; i++)
+                bytes[pos + i] = static_cast<unsigned char>(value >> (24 - 8 * i));
+        }
+    };
+
+    // builds a minimal profile with a single lut16 (mft2) tag of inputs to 3 channels,
+    // the first three inputs map to the outputs
+    std::vector<unsigned char> lut16_profile(unsigned grid, color_space_t pcs, color_space_t device,
+                                             tag_signature_t tag, unsigned inputs)
+    {
+        profile_writer_t w;
+        w.bytes.resize(128);
+        w.at32(16, static_cast<unsigned>(device));
+        w.at32(20, static_cast<unsigned>(pcs));
+        w.at32(36, static_cast<unsigned>(specials_t::MagicNumber));
+        w.u32(1);
+        w.u32(static_cast<unsigned>(tag));
+        w.u32(144);
+        w.u32(0);
+        size_t start = w.bytes.size();
+        w.u32(static_cast<unsigned>(tag_type_t::Lut16Type));
+        w.u32(0);
+        w.u8(inputs);
+        w.u8(3);
+        w.u8(grid);
+        w.u8(0);
+        for (int i = 0; i < 9; i++)
+            w.u32(i % 4 == 0 ? 0x10000 : 0);
+        w.u16(2);
+        w.u16(2);
+        for (unsigned i = 0; i < inputs; i++)
+        {
+            w.u16(0);
+            w.u16(0xffff);
+        }
+        size_t points = 1;
+        for (unsigned i = 0; i < inputs; i++)
+            points *= grid;
+        for (size_t point = 0; point < points; point++)
+        {
+            size_t index = point;
+            unsigned coordinate[4] = { 0, 0, 0, 0 };
+            for (unsigned i = inputs; i-- > 0; index /= grid)
+                coordinate[i] = static_cast<unsigned>(index % grid);
+            for (int i = 0; i < 3; i++)
+                w.u16(coordinate[i] * 0xffff / (grid - 1));
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            w.u16(0);
+            w.u16(0xffff);
+        }
+        w.at32(140, static_cast<unsigned>(w.bytes.size() - start));
+        w.at32(0, static_cast<unsigned>(w.bytes.size()));
+        return w.bytes;
+    }
+    // a PCS -> RGB B2A0 tag, PCS XYZ by default
+    std::vector<unsigned char> lut16_profile(unsigned grid = 3, color_space_t pcs = color_space_t::XYZData)
+    {
+        return lut16_profile(grid, pcs, color_space_t::RgbData, tag_signature_t::BToA0Tag, 3);
+    }
+}
+
+/// @brief the same profile read from memory, from a mapped file and from a stream
+BOOST_AUTO_TEST_CASE(icc_memory_reader)
+{
+    std::vector<unsigned char> bytes = lut16_profile();
+    const char *path = "iccpp_reader_test.icc";
+    {
+        std::ofstream ost(path, std::ios_base::binary);
+        ost.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+    std::unique_ptr<std::ifstream> stream(new std::ifstream(path, std::ios_base::binary));
+    std::unique_ptr<profile_t> profiles[] = { std::unique_ptr<profile_t>(profile_t::create(bytes.data(), bytes.size())),
+                                              std::unique_ptr<profile_t>(profile_t::create(path)),
+                                              std::unique_ptr<profile_t>(profile_t::create(stream)) };
+    std::remove(path);
+    xyz_t xyz = { 0.2, 0.4, 0.6 };
+    rgb_t<double> expected = { 0.0, 0.0, 0.0 };
+    for (size_t i = 0; i < 3; i++)
+    {
+        BOOST_CHECK(profiles[i]);
+        if (!profiles[i])
+            continue;
+        BOOST_CHECK(profiles[i]->device() == color_space_t::RgbData);
+        function_t<rgb_t<double>, xyz_t> f = profiles[i]->pcs2device<rgb_t<double>, xyz_t>();
+        BOOST_CHECK(f);
+        if (!f)
+            continue;
+        rgb_t<double> rgb = f(xyz);
+        if (i == 0)
+            expected = rgb;
+        BOOST_CHECK(rgb.red == expected.red && rgb.green == expected.green && rgb.blue == expected.blue);
+        BOOST_CHECK(rgb.red < rgb.green && rgb.green < rgb.blue);
+    }
+
+    // a tag whose declared size cuts the CLUT must not be read past its end
+    std::vector<unsigned char> cut = bytes;
+    cut[140 + 2] = 0;
+    cut[140 + 3] = 64;
+    std::unique_ptr<profile_t> truncated(profile_t::create(cut.data(), cut.size()));
+    BOOST_CHECK(truncated);
+    bool thrown = false;
+    try
+    {
+        truncated->pcs2device<rgb_t<double>, xyz_t>();
+    }
+    catch (const icc_file_exception_t &)
+    {
+        thrown = true;
+    }
+    BOOST_CHECK(thrown);
+
+    // too short to hold a header
+    std::unique_ptr<profile_t> empty(profile_t::create(bytes.data(), 64));
+    BOOST_CHECK(!empty);
+}
+
+/// @brief a grid of 17 points gets a fixed grid table, interpolating as the generic one
+BOOST_AUTO_TEST_CASE(icc_fixed_grid_clut)
+{
+    std::vector<unsigned char> small = lut16_profile();
+    std::vector<unsigned char> common = lut16_profile(17);
+    std::unique_ptr<profile_t> generic(profile_t::create(small.data(), small.size()));
+    std::unique_ptr<profile_t> fixed(profile_t::create(common.data(), common.size()));
+    BOOST_CHECK(generic && fixed);
+    if (!generic || !fixed)
+        return;
+    function_t<rgb_t<double>, xyz_t> f = generic->pcs2device<rgb_t<double>, xyz_t>();
+    function_t<rgb_t<double>, xyz_t> g = fixed->pcs2device<rgb_t<double>, xyz_t>();
+    std::ostringstream f_stages, g_stages;
+    dump_stages(f_stages, f);
+    dump_stages(g_stages, g);
+    BOOST_CHECK(f_stages.str().find("fixed_grid_lut_t") == std::string::npos);
+    BOOST_CHECK(g_stages.str().find("fixed_grid_lut_t") != std::string::npos);
+    // the table is linear up to the 16 bit rounding of its entries
+    for (int i = 0; i <= 10; i++)
+    {
+        xyz_t xyz = { 0.1 * i, 0.05 * i, 0.1 * (10 - i) };
+        rgb_t<double> expected = f(xyz);
+        rgb_t<double> rgb = g(xyz);
+        BOOST_CHECK(std::fabs(rgb.red - expected.red) < 1e-4 &&
+                    std::fabs(rgb.green - expected.green) < 1e-4 &&
+                    std::fabs(rgb.blue - expected.blue) < 1e-4);
+    }
+}
+
+/// @brief Lab PCS profiles interpolate multilinear, XYZ PCS profiles and CMYK tables tetrahedral
+BOOST_AUTO_TEST_CASE(icc_clut_interpolation)
+{
+    std::vector<unsigned char> lab_pcs = lut16_profile(3, color_space_t::LabData);
+    std::vector<unsigned char> xyz_pcs = lut16_profile(3, color_space_t::XYZData);
+    std::unique_ptr<profile_t> lab_in(profile_t::create(lab_pcs.data(), lab_pcs.size()));
+    std::unique_ptr<profile_t> xyz_in(profile_t::create(xyz_pcs.data(), xyz_pcs.size()));
+    BOOST_CHECK(lab_in && xyz_in);
+    if (!lab_in || !xyz_in)
+        return;
+    function_t<rgb_t<double>, lab_t> f = lab_in->pcs2device<rgb_t<double>, lab_t>();
+    function_t<rgb_t<double>, xyz_t> g = xyz_in->pcs2device<rgb_t<double>, xyz_t>();
+    BOOST_CHECK(f && g);
+    std::ostringstream f_stages, g_stages;
+    dump_stages(f_stages, f);
+    dump_stages(g_stages, g);
+    BOOST_CHECK(f_stages.str().find("interp_multi_t") != std::string::npos);
+    BOOST_CHECK(f_stages.str().find("interp_tetra_t") == std::string::npos);
+    BOOST_CHECK(g_stages.str().find("interp_tetra_t") != std::string::npos);
+    BOOST_CHECK(g_stages.str().find("interp_multi_t") == std::string::npos);
+
+    // a CMYK table goes to the simplex kernel even with a Lab PCS
+    std::vector<unsigned char> cmyk_lab = lut16_profile(3, color_space_t::LabData, color_space_t::CmykData,
+                                                        tag_signature_t::AToB0Tag, 4);
+    std::unique_ptr<profile_t> cmyk(profile_t::create(cmyk_lab.data(), cmyk_lab.size()));
+    BOOST_CHECK(cmyk);
+    if (!cmyk)
+        return;
+    function_t<lab_t, vector_t<double, 4>> h = cmyk->device2pcs<lab_t, vector_t<double, 4>>();
+    BOOST_CHECK(h);
+    std::ostringstream h_stages;
+    dump_stages(h_stages, h);
+    BOOST_CHECK(h_stages.str().find("interp_tetra_t") != std::string::npos);
+    BOOST_CHECK(h_stages.str().find("interp_multi_t") == std::string::npos);
+}
+
+/// @brief profiles are shared by ID or by content and evicted past the budget
+BOOST_AUTO_TEST_CASE(icc_profile_cache)
+{
+    std::vector<unsigned char> bytes = lut16_profile();
+    std::vector<unsigned char> copy = bytes;
+    profile_cache_t cache;
+    std::shared_ptr<profile_t> first = cache.get(bytes.data(), bytes.size());
+    BOOST_CHECK(first);
+    if (!first)
+        return;
+    size_t bare = first->footprint();
+    BOOST_CHECK(cache.footprint() == bare);
+    // the cache owns a copy of the bytes
+    std::unique_ptr<profile_t> borrowing(profile_t::create(bytes.data(), bytes.size()));
+    BOOST_CHECK(bare >= borrowing->footprint() + bytes.size());
+    // no profile ID: the content hash matches
+    std::shared_ptr<profile_t> second = cache.get(copy.data(), copy.size());
+    BOOST_CHECK(first == second);
+    BOOST_CHECK(cache.size() == 1);
+    // the cached profile does not depend on the caller buffer
+    std::fill(bytes.begin(), bytes.end(), 0);
+    function_t<rgb_t<double>, xyz_t> f = second->pcs2device<rgb_t<double>, xyz_t>();
+    BOOST_CHECK(f);
+    // the decoded tags are counted, at least the 3x3x3 table of 3 doubles,
+    // and charged to the cache at the next lookup
+    BOOST_CHECK(first->footprint() >= bare + 27 * 3 * sizeof(double));
+    BOOST_CHECK(cache.footprint() == bare);
+    BOOST_CHECK(cache.get(copy.data(), copy.size()) == first);
+    BOOST_CHECK(cache.footprint() == first->footprint());
+
+    // same ID, different content: still the same profile
+    cache.budget(first->footprint());
+    std::vector<unsigned char> id1 = copy;
+    id1[84] = 1;
+    std::vector<unsigned char> id1b = id1;
+    id1b[127] = 1;
+    std::shared_ptr<profile_t> third = cache.get(id1.data(), id1.size());
+    BOOST_CHECK(third && third != first);
+    BOOST_CHECK(cache.get(id1b.data(), id1b.size()) == third);
+    // budget holds the decoded profile alone, the older one is gone
+    BOOST_CHECK(cache.size() == 1);
+    BOOST_CHECK(third && cache.footprint() == third->footprint());
+    BOOST_CHECK(cache.get(copy.data(), copy.size()) != first);
+
+    BOOST_CHECK(!cache.get(copy.data(), 64));
+    cache.budget(0);
+    BOOST_CHECK(cache.size() == 0);
+    BOOST_CHECK(cache.get(id1.data(), id1.size()));
+    BOOST_CHECK(cache.size() == 0);
+}
+
+/// @brief files are found again by path, size and time, a changed file is read again
+BOOST_AUTO_TEST_CASE(icc_profile_cache_file)
+{
+    std::vector<unsigned char> bytes = lut16_profile();
+    const char *path = "iccpp_cache_test.icc";
+    {
+        std::ofstream ost(path, std::ios_base::binary);
+        ost.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+    profile_cache_t cache;
+    std::shared_ptr<profile_t> first = cache.get(path);
+    BOOST_CHECK(first);
+    BOOST_CHECK(cache.get(path) == first);
+    BOOST_CHECK(cache.get(bytes.data(), bytes.size()) == first);
+    // another profile, with a different size
+    bytes[84] = 1;
+    bytes.push_back(0);
+    {
+        std::ofstream ost(path, std::ios_base::binary);
+        ost.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+    std::shared_ptr<profile_t> second = cache.get(path);
+    BOOST_CHECK(second && second != first);
+    BOOST_CHECK(cache.size() == 2);
+    std::remove(path);
+    BOOST_CHECK(!cache.get(path));
+    BOOST_CHECK(!cache.get("iccpp_no_such_file.icc"));
+}
+
+/// @brief load_all decodes the tags up front, the source is not read afterwards
+BOOST_AUTO_TEST_CASE(icc_load_all)
+{
+    std::vector<unsigned char> bytes = lut16_profile();
+    xyz_t xyz = { 0.2, 0.4, 0.6 };
+    std::unique_ptr<profile_t> lazy(profile_t::create(bytes.data(), bytes.size()));
+    rgb_t<double> expected = lazy->pcs2device<rgb_t<double>, xyz_t>()(xyz);
+
+    std::vector<unsigned char> copy = bytes;
+    std::unique_ptr<profile_t> eager(profile_t::create(copy.data(), copy.size()));
+    eager->load_all();
+    std::fill(copy.begin(), copy.end(), 0);
+    function_t<rgb_t<double>, xyz_t> f = eager->pcs2device<rgb_t<double>, xyz_t>();
+    BOOST_CHECK(f);
+    if (f)
+    {
+        rgb_t<double> rgb = f(xyz);
+        BOOST_CHECK(rgb.red == expected.red && rgb.green == expected.green && rgb.blue == expected.blue);
+    }
+
+    // a broken tag is reported at load time
+    std::vector<unsigned char> cut = bytes;
+    cut[140 + 2] = 0;
+    cut[140 + 3] = 64;
+    std::unique_ptr<profile_t> truncated(profile_t::create(cut.data(), cut.size()));
+    bool thrown = false;
+    try
+    {
+        truncated->load_all();
+    }
+    catch (const icc_file_exception_t &)
+    {
+        thrown = true;
+    }
+    BOOST_CHECK(thrown);
+
+    profile_cache_t cache;
+    std::shared_ptr<profile_t> warm = cache.prewarm(bytes.data(), bytes.size());
+    BOOST_CHECK(warm && cache.size() == 1);
+    // charged for the decoded tags at once
+    BOOST_CHECK(warm && cache.footprint() == warm->footprint());
+    BOOST_CHECK(warm && warm->footprint() >= bytes.size() + 27 * 3 * sizeof(double));
+    BOOST_CHECK(cache.get(bytes.data(), bytes.size()) == warm);
+    BOOST_CHECK(!cache.prewarm(bytes.data(), 64));
+}
+
+/// @brief transforms are shared by profiles, intent, types and options
+BOOST_AUTO_TEST_CASE(icc_transform_cache)
+{
+    using pixel_t = rgb_t<double>;
+    using pixel8_t = rgb_t<unsigned char>;
+    std::vector<unsigned char> bytes = lut16_profile();
+    std::shared_ptr<profile_t> output(profile_t::create(bytes.data(), bytes.size()));
+    std::shared_ptr<profile_t> input(profile_t::create_sRGB());
+    transform_cache_t cache(2);
+
+    function_t<pixel_t, pixel_t> f = cache.get<pixel_t, pixel_t>(output, input);
+    BOOST_CHECK(f);
+    if (!f)
+        return;
+    pixel_t x(0.2, 0.4, 0.6);
+    pixel_t y = f(x);
+    pixel_t expected = profile_t::transform<pixel_t, pixel_t>(*output, *input)(x);
+    BOOST_CHECK(y.red == expected.red && y.green == expected.green && y.blue == expected.blue);
+
+    function_t<pixel_t, pixel_t> g = cache.get<pixel_t, pixel_t>(output, input);
+    BOOST_CHECK(g.imp() == f.imp());
+    transform_cache_t::statistics_t stats = cache.statistics();
+    BOOST_CHECK(stats.hits == 1 && stats.misses == 1 && stats.evictions == 0);
+
+    function_t<pixel_t, pixel_t> p = cache.get<pixel_t, pixel_t>(output, input, rendering_intent_t::perceptual);
+    BOOST_CHECK(p.imp() != f.imp());
+    function_t<pixel8_t, pixel8_t> b = cache.get<pixel8_t, pixel8_t>(output, input);
+    BOOST_CHECK(b);
+    stats = cache.statistics();
+    BOOST_CHECK(stats.hits == 1 && stats.misses == 3 && stats.evictions == 1);
+    BOOST_CHECK(cache.size() == 2);
+    // the least recently used one is gone
+    BOOST_CHECK((cache.get<pixel_t, pixel_t>(output, input).imp() != f.imp()));
+
+    // a new profile is a new key, even at the same address
+    input.reset(profile_t::create_sRGB());
+    BOOST_CHECK((cache.get<pixel_t, pixel_t>(output, input).imp() != f.imp()));
+    BOOST_CHECK(cache.statistics().misses == 5);
+}
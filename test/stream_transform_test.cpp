@@ -0,0 +1,168 @@
+//---------------------------------------------------------------------------------
+//
+//  LIBICC++  
+//  Copyright Marco Oman 2015
+//
+// Distributed under the Boost Software License, Version 1.0. 
+// (See accompanying file LICENSE_1_0.txt or copy at 
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+
+/**	@file: stream_transform_test.cpp
+
+    @brief Test of the streaming transform of PPM, PAM and raw rasters
+*/
+
+#ifdef HAVE_BOOST_TEST
+#include <boost/test/auto_unit_test.hpp>
+#else
+#include "test_registrar.h"
+#endif
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include "iccpp_stream_transform.h"
+
+using namespace iccpp;
+
+namespace
+{
+    // adds delta to every channel
+    template <class Y, class X>
+    class shift_t : public algo_t<Y, X>
+    {
+    public:
+        explicit shift_t(int delta) : delta_(delta) {}
+        virtual Y eval(const X &x) const override
+        {
+            Y y;
+            for (int c = 0; c < channel_traits_t<Y>::channels; c++)
+                channel_traits_t<Y>::set(y, c, static_cast<typename channel_traits_t<Y>::scalar_type>(channel_traits_t<X>::get(x, c) + delta_));
+            return y;
+        }
+        virtual shift_t<Y, X> *clone(void) const override
+        {
+            return new shift_t<Y, X>(delta_);
+        }
+    private:
+        int delta_;
+    };
+
+    std::string samples(size_t count, int step)
+    {
+        std::string result;
+        for (size_t i = 0; i < count; i++)
+            result += static_cast<char>(i * step);
+        return result;
+    }
+}
+
+/// @brief chunks of lines go through the pipeline in order
+BOOST_AUTO_TEST_CASE(stream_transform_ppm)
+{
+    using pixel_t = rgb_t<unsigned char>;
+    const size_t width = 5, height = 10;
+    std::string data = samples(width * height * 3, 1);
+    function_t<pixel_t, pixel_t> f(new shift_t<pixel_t, pixel_t>(1));
+    worker_pool_t pool(3);
+    for (int variant = 0; variant < 3; variant++)
+    {
+        std::istringstream ist("P6\n# comment\n5 10\n255\n" + data);
+        std::ostringstream ost;
+        stream_raster_io_t in(ist), out(ost);
+        stream_transform_t<pixel_t, pixel_t> stream(f, variant == 0 ? 64 : 3, variant == 2 ? &pool : nullptr);
+        stream.pnm(in, out);
+        std::string expected = "P6\n5 10\n255\n" + samples(width * height * 3, 1);
+        for (size_t i = 12; i < expected.size(); i++)
+            expected[i]++;
+        BOOST_CHECK(ost.str() == expected);
+    }
+
+    // raw pixels, no header
+    std::istringstream ist(data);
+    std::ostringstream ost;
+    stream_raster_io_t in(ist), out(ost);
+    stream_transform_t<pixel_t, pixel_t>(f, 4).raw(in, out, width, height);
+    BOOST_CHECK(ost.str().size() == data.size() && ost.str()[7] == data[7] + 1);
+}
+
+/// @brief 16 bit samples are big endian in the files
+BOOST_AUTO_TEST_CASE(stream_transform_16bit)
+{
+    using pixel8_t = rgb_t<unsigned char>;
+    using pixel16_t = rgb_t<unsigned short>;
+    std::istringstream ist(std::string("P6 1 1 65535\n\x01\x02\x01\x02\x01\xff", 19));
+    std::ostringstream ost;
+    stream_raster_io_t in(ist), out(ost);
+    stream_transform_t<pixel16_t, pixel16_t>(function_t<pixel16_t, pixel16_t>(new shift_t<pixel16_t, pixel16_t>(1))).pnm(in, out);
+    BOOST_CHECK(ost.str() == std::string("P6\n1 1\n65535\n\x01\x03\x01\x03\x02\x00", 19));
+
+    // 8 bit in, 16 bit out
+    std::istringstream ist8(std::string("P6 1 1 255\n\x01\x02\x03", 14));
+    std::ostringstream ost16;
+    stream_raster_io_t in8(ist8), out16(ost16);
+    stream_transform_t<pixel16_t, pixel8_t>(function_t<pixel16_t, pixel8_t>(new shift_t<pixel16_t, pixel8_t>(256))).pnm(in8, out16);
+    BOOST_CHECK(ost16.str() == std::string("P6\n1 1\n65535\n\x01\x01\x01\x02\x01\x03", 19));
+}
+
+/// @brief 4 channels go through PAM, errors are reported
+BOOST_AUTO_TEST_CASE(stream_transform_pam)
+{
+    using cmyk_t = vector_t<unsigned char, 4>;
+    std::string data = samples(2 * 3 * 4, 3);
+    std::istringstream ist("P7\nWIDTH 2\nHEIGHT 3\nDEPTH 4\nMAXVAL 255\nTUPLTYPE CMYK\nENDHDR\n" + data);
+    std::ostringstream ost;
+    stream_raster_io_t in(ist), out(ost);
+    function_t<cmyk_t, cmyk_t> f(new identity_t<cmyk_t>);
+    stream_transform_t<cmyk_t, cmyk_t>(f, 1).pnm(in, out);
+    BOOST_CHECK(ost.str() == "P7\nWIDTH 2\nHEIGHT 3\nDEPTH 4\nMAXVAL 255\nTUPLTYPE CMYK\nENDHDR\n" + data);
+
+    const char *broken[] = { "P6\n2 3\n255\n",                  // truncated samples
+                             "P7\nWIDTH 2\nHEIGHT 3\nDEPTH 3\nMAXVAL 255\nENDHDR\n", // 3 channels
+                             "P6\n2 3\n1023\n",                 // 10 bit
+                             "P5\n2 3\n255\n" };
+    for (const char *text : broken)
+    {
+        std::istringstream bad(std::string(text) + data.substr(0, 10));
+        std::ostringstream discarded;
+        stream_raster_io_t bad_in(bad), bad_out(discarded);
+        bool thrown = false;
+        try
+        {
+            stream_transform_t<cmyk_t, cmyk_t>(f, 1).pnm(bad_in, bad_out);
+        }
+        catch (const raster_exception_t &)
+        {
+            thrown = true;
+        }
+        BOOST_CHECK(thrown);
+    }
+}
+
+#ifndef _WIN32
+/// @brief file descriptors as source and sink
+BOOST_AUTO_TEST_CASE(stream_transform_fd)
+{
+    using pixel_t = rgb_t<unsigned char>;
+    const char *input = "iccpp_stream_in.ppm";
+    const char *output = "iccpp_stream_out.ppm";
+    std::string data = samples(64 * 64 * 3, 7);
+    {
+        std::ofstream ost(input, std::ios_base::binary);
+        ost << "P6\n64 64\n255\n" << data;
+    }
+    int in_fd = open(input, O_RDONLY);
+    int out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    BOOST_CHECK(in_fd >= 0 && out_fd >= 0);
+    fd_raster_io_t in(in_fd), out(out_fd);
+    stream_transform_t<pixel_t, pixel_t>(function_t<pixel_t, pixel_t>(new identity_t<pixel_t>), 5).pnm(in, out);
+    close(in_fd);
+    close(out_fd);
+    std::ifstream ist(output, std::ios_base::binary);
+    std::string result((std::istreambuf_iterator<char>(ist)), std::istreambuf_iterator<char>());
+    BOOST_CHECK(result == "P6\n64 64\n255\n" + data);
+    std::remove(input);
+    std::remove(output);
+}
+#endif